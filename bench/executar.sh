@@ -0,0 +1,117 @@
+#!/bin/sh
+# Benchmark of the analysis on synthetic data (bench/gerar_dados.c).
+#
+# Strong scaling: for each size in LINHAS, runs the analysis with each process
+# count in PROCESSOS on the same data. Weak scaling: for each process count p,
+# runs on LINHAS_POR_PROCESSO * p rows. Reports the best of REPETICOES runs as
+# rows/s (rows of all files read), MB/s and scaling efficiency, and writes the
+# same table as CSV.
+#
+# Run from the root of the project:
+#   sh bench/executar.sh
+#   PROCESSOS="1 2 4 8" LINHAS="1000000 4000000" ARGS="--threads 2" sh bench/executar.sh
+#
+# Variables (defaults in parentheses):
+#   PROCESSOS            process counts ("1 2 4")
+#   LINHAS               rows per file for strong scaling ("200000 800000")
+#   LINHAS_POR_PROCESSO  rows per file and process for weak scaling (200000)
+#   REPETICOES           runs of each point, the fastest is kept (3)
+#   ARGS                 extra options of ./main, e.g. "--cache" ("")
+#   GERADOR              extra options of gerar_dados, e.g. "--assimetria 1.5" ("")
+#   MPIRUN               launcher ("mpirun"); MPICC, CC compilers
+#   SAIDA                CSV file (bench/resultados.csv)
+
+set -e
+
+PROCESSOS=${PROCESSOS:-"1 2 4"}
+LINHAS=${LINHAS:-"200000 800000"}
+LINHAS_POR_PROCESSO=${LINHAS_POR_PROCESSO:-200000}
+REPETICOES=${REPETICOES:-3}
+ARGS=${ARGS:-}
+GERADOR=${GERADOR:-}
+MPIRUN=${MPIRUN:-mpirun}
+MPICC=${MPICC:-mpicc}
+CC=${CC:-cc}
+SAIDA=${SAIDA:-bench/resultados.csv}
+
+RAIZ=$(pwd)
+BUILD=$RAIZ/bench/_build
+DADOS=$RAIZ/bench/_dados
+
+mkdir -p "$BUILD" "$DADOS"
+$MPICC -O2 -o "$BUILD/main" main.c
+$CC -O2 -o "$BUILD/gerar_dados" bench/gerar_dados.c -lm
+
+# Data set of $1 rows per file, generated once and kept between runs
+preparar_dados() {
+    dir=$DADOS/$1
+    if [ ! -f "$dir/.completo" ]; then
+        rm -rf "$dir"
+        "$BUILD/gerar_dados" --linhas "$1" --destino "$dir" $GERADOR >/dev/null
+        touch "$dir/.completo"
+    fi
+}
+
+# Bytes of all files of a data set
+bytes_dados() {
+    cat "$DADOS/$1"/2.DADOS/*.txt | wc -c | tr -d ' '
+}
+
+# Number of files of a data set; every file has one row per student
+arquivos_dados() {
+    ls "$DADOS/$1"/2.DADOS/*.txt | wc -l | tr -d ' '
+}
+
+# Best wall time, in seconds, of the analysis of data set $1 with $2 processes
+medir() {
+    melhor=""
+    r=0
+    while [ "$r" -lt "$REPETICOES" ]; do
+        inicio=$(date +%s.%N)
+        (cd "$DADOS/$1" && $MPIRUN -n "$2" "$BUILD/main" $ARGS >/dev/null)
+        fim=$(date +%s.%N)
+        melhor=$(awk -v i="$inicio" -v f="$fim" -v m="$melhor" 'BEGIN { t = f - i; if (m == "" || t < m) m = t; printf "%.4f", m }')
+        r=$((r + 1))
+    done
+    echo "$melhor"
+}
+
+echo "escala,linhas,processos,segundos,linhas_por_s,mb_por_s,eficiencia" >"$SAIDA"
+printf "%-6s %10s %9s %9s %14s %9s %11s\n" escala linhas processos segundos linhas/s MB/s eficiencia
+
+# $1 scale, $2 rows per file, $3 processes, $4 seconds, $5 bytes, $6 reference
+# time, $7 files; linhas/s counts the rows of all files
+relatar() {
+    awk -v e="$1" -v l="$2" -v p="$3" -v t="$4" -v b="$5" -v ref="$6" -v a="$7" -v saida="$SAIDA" 'BEGIN {
+        ef = e == "forte" ? ref / (p * t) : ref / t
+        printf "%-6s %10d %9d %9.3f %14.0f %9.1f %10.1f%%\n", e, l, p, t, l * a / t, b / t / 1048576, ef * 100
+        printf "%s,%d,%d,%.4f,%.0f,%.2f,%.4f\n", e, l, p, t, l * a / t, b / t / 1048576, ef >> saida
+    }'
+}
+
+# Strong scaling: efficiency = T(p0) * p0 / (p * T(p)), p0 the first process count
+for linhas in $LINHAS; do
+    preparar_dados "$linhas"
+    bytes=$(bytes_dados "$linhas")
+    arquivos=$(arquivos_dados "$linhas")
+    referencia=""
+    for p in $PROCESSOS; do
+        t=$(medir "$linhas" "$p")
+        [ -z "$referencia" ] && referencia=$(awk -v t="$t" -v p="$p" 'BEGIN { print t * p }')
+        relatar forte "$linhas" "$p" "$t" "$bytes" "$referencia" "$arquivos"
+    done
+done
+
+# Weak scaling: efficiency = T(p0) / T(p), with data growing with p
+referencia=""
+for p in $PROCESSOS; do
+    linhas=$((LINHAS_POR_PROCESSO * p))
+    preparar_dados "$linhas"
+    bytes=$(bytes_dados "$linhas")
+    arquivos=$(arquivos_dados "$linhas")
+    t=$(medir "$linhas" "$p")
+    [ -z "$referencia" ] && referencia=$t
+    relatar fraca "$linhas" "$p" "$t" "$bytes" "$referencia" "$arquivos"
+done
+
+echo "Resultados em $SAIDA"
@@ -0,0 +1,311 @@
+// Synthetic data generator for the benchmarks: writes 2.DADOS-style files with
+// the layout of the ENADE 2014 microdata, without the INEP download. Every
+// file has the same rows in the same order (one student per row), as the real
+// split files do. File 1 holds the courses (CO_GRUPO in column 6), file 3 the
+// scores, file 5 TP_SEXO and files 6 to 42 one questionnaire item each
+// (QE_I01 to QE_I37), so the analyzed questions live in files 20 to 28.
+//
+// Compile: cc -O2 -o gerar_dados bench/gerar_dados.c -lm
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#else
+#include <direct.h>
+#endif
+
+#define MAX_FILENAME 512
+#define TOTAL_ARQUIVOS 42
+#define GRUPO_ADS 72
+#define BUFFER_SAIDA (1 << 20)
+
+typedef struct
+{
+    long long linhas;   // Rows (students) per file
+    int arquivos;       // Files written, from file 1 on
+    int cursos;         // Distinct CO_CURSO codes
+    double fracao_ads;  // Fraction of rows of ADS courses
+    double assimetria;  // Zipf exponent of the rows per course (0: uniform)
+    double vazias;      // Fraction of empty responses
+    double incompletas; // Fraction of truncated lines
+    int crlf;           // Ends lines with CRLF
+    unsigned long long semente;
+    const char *destino;
+} Parametros;
+
+// --- Random numbers (splitmix64) ---
+
+static unsigned long long proximo_aleatorio(unsigned long long *estado)
+{
+    unsigned long long z = (*estado += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+static double uniforme(unsigned long long *estado)
+{
+    return (proximo_aleatorio(estado) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// --- Courses ---
+// The courses are split in an ADS group and the rest. A row picks the group
+// with probability fracao_ads, then a course of the group from a Zipf
+// distribution, so a few courses hold most of the students.
+
+typedef struct
+{
+    int *codigos;
+    double *acumulada; // Cumulative Zipf weights
+    int num;
+} GrupoCursos;
+
+static void iniciar_grupo(GrupoCursos *g, int primeiro_codigo, int num, double assimetria)
+{
+    g->num = num;
+    g->codigos = malloc(num * sizeof(int));
+    g->acumulada = malloc(num * sizeof(double));
+
+    double soma = 0.0;
+    for (int i = 0; i < num; i++)
+    {
+        g->codigos[i] = primeiro_codigo + i;
+        soma += 1.0 / pow(i + 1, assimetria);
+        g->acumulada[i] = soma;
+    }
+    for (int i = 0; i < num; i++)
+        g->acumulada[i] /= soma;
+}
+
+static int sortear_curso(const GrupoCursos *g, unsigned long long *estado)
+{
+    double u = uniforme(estado);
+    int ini = 0, fim = g->num - 1;
+    while (ini < fim)
+    {
+        int meio = (ini + fim) / 2;
+        if (g->acumulada[meio] < u)
+            ini = meio + 1;
+        else
+            fim = meio;
+    }
+    return g->codigos[ini];
+}
+
+// --- Files ---
+
+static void criar_diretorio(const char *caminho)
+{
+#ifndef _WIN32
+    mkdir(caminho, 0755);
+#else
+    _mkdir(caminho);
+#endif
+}
+
+// Name of the variable of file i (1-based) for files with one variable
+static void nome_variavel(int arquivo, char *nome, size_t tamanho)
+{
+    if (arquivo == 5)
+        snprintf(nome, tamanho, "TP_SEXO");
+    else if (arquivo >= 6)
+        snprintf(nome, tamanho, "QE_I%02d", arquivo - 5);
+    else
+        snprintf(nome, tamanho, "CO_CATEGAD");
+}
+
+// Number of categories (letters A, B, ...) of each questionnaire item; the
+// analyzed ones follow the real questionnaire
+static int categorias_item(int item)
+{
+    switch (item)
+    {
+    case 15:
+        return 6;
+    case 19:
+        return 7;
+    case 21:
+        return 2;
+    default:
+        return 5;
+    }
+}
+
+// Writes file `arquivo`. The course of each row comes from a generator reset
+// to the same seed for every file, so all files list the same students.
+static int escrever_arquivo(const Parametros *par, int arquivo, const GrupoCursos *ads, const GrupoCursos *outros)
+{
+    char caminho[MAX_FILENAME];
+    snprintf(caminho, sizeof(caminho), "%s/2.DADOS/microdados2014_arq%d.txt", par->destino, arquivo);
+
+    FILE *fp = fopen(caminho, "wb");
+    if (!fp)
+        return -1;
+    char *buffer = malloc(BUFFER_SAIDA);
+    setvbuf(fp, buffer, _IOFBF, BUFFER_SAIDA);
+
+    const char *nl = par->crlf ? "\r\n" : "\n";
+    char variavel[16];
+    nome_variavel(arquivo, variavel, sizeof(variavel));
+
+    if (arquivo == 1)
+        fprintf(fp, "NU_ANO;CO_CURSO;CO_IES;CO_CATEGAD;CO_ORGACAD;CO_GRUPO;CO_MODALIDADE;CO_MUNIC_CURSO;CO_UF_CURSO;CO_REGIAO_CURSO%s", nl);
+    else if (arquivo == 3)
+        fprintf(fp, "NU_ANO;CO_CURSO;TP_PRES;TP_PR_GER;NT_GER;NT_FG;NT_CE%s", nl);
+    else
+        fprintf(fp, "NU_ANO;CO_CURSO;%s%s", variavel, nl);
+
+    unsigned long long estado_cursos = par->semente;
+    unsigned long long estado = par->semente * 31 + (unsigned long long)arquivo;
+    int item = arquivo >= 6 ? arquivo - 5 : 0;
+
+    for (long long r = 0; r < par->linhas; r++)
+    {
+        int ehads = uniforme(&estado_cursos) < par->fracao_ads;
+        int curso = sortear_curso(ehads ? ads : outros, &estado_cursos);
+
+        // Truncated line: the row stops after NU_ANO or CO_CURSO
+        if (uniforme(&estado) < par->incompletas)
+        {
+            if (proximo_aleatorio(&estado) & 1)
+                fprintf(fp, "2014%s", nl);
+            else
+                fprintf(fp, "2014;%d%s", curso, nl);
+            continue;
+        }
+
+        int vazia = uniforme(&estado) < par->vazias;
+        if (arquivo == 1)
+        {
+            int grupo = ehads ? GRUPO_ADS : (curso % 2 ? 2 : 4003);
+            fprintf(fp, "2014;%d;%d;%d;%d;%d;%d;%d;%d;%d%s",
+                    curso, 1 + curso % 2000, 1 + curso % 7, 10019 + curso % 5, grupo,
+                    1, 1100000 + curso % 5000, 11 + curso % 43, 1 + curso % 5, nl);
+        }
+        else if (arquivo == 3)
+        {
+            // TP_PR_GER: 555 (valid), 222/333/444/556 (absent or invalid)
+            static const int codigos_pr[] = {555, 555, 555, 555, 555, 555, 555, 555, 222, 333, 444, 556};
+            int pr = codigos_pr[proximo_aleatorio(&estado) % 12];
+            if (vazia)
+            {
+                fprintf(fp, "2014;%d;555;;;;%s", curso, nl);
+                continue;
+            }
+            if (pr != 555)
+            {
+                fprintf(fp, "2014;%d;%d;%d;;;%s", curso, pr, pr, nl);
+                continue;
+            }
+            double nt_ger = uniforme(&estado) * 100.0;
+            double nt_fg = uniforme(&estado) * 100.0;
+            double nt_ce = uniforme(&estado) * 100.0;
+            // Scores use a comma as the decimal separator
+            fprintf(fp, "2014;%d;555;555;%d,%d;%d,%d;%d,%d%s", curso,
+                    (int)nt_ger, (int)(nt_ger * 10) % 10, (int)nt_fg, (int)(nt_fg * 10) % 10,
+                    (int)nt_ce, (int)(nt_ce * 10) % 10, nl);
+        }
+        else if (arquivo == 5)
+        {
+            fprintf(fp, "2014;%d;%s%s", curso, vazia ? "" : (proximo_aleatorio(&estado) & 1 ? "M" : "F"), nl);
+        }
+        else if (item > 0)
+        {
+            char resposta[2] = {0, 0};
+            if (!vazia)
+                resposta[0] = (char)('A' + proximo_aleatorio(&estado) % categorias_item(item));
+            fprintf(fp, "2014;%d;%s%s", curso, resposta, nl);
+        }
+        else
+        {
+            fprintf(fp, "2014;%d;%d%s", curso, 1 + (int)(proximo_aleatorio(&estado) % 5), nl);
+        }
+    }
+
+    int ok = fclose(fp) == 0;
+    free(buffer);
+    return ok ? 0 : -1;
+}
+
+static void uso(const char *programa)
+{
+    fprintf(stderr,
+            "Uso: %s [--linhas N] [--arquivos N] [--cursos N] [--fracao-ads F] [--assimetria S]\n"
+            "          [--vazias F] [--incompletas F] [--crlf] [--semente N] [--destino DIR]\n",
+            programa);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    Parametros par = {100000, TOTAL_ARQUIVOS, 5000, 0.05, 1.0, 0.03, 0.002, 0, 2014, "."};
+
+    for (int i = 1; i < argc; i++)
+    {
+        int tem_valor = i + 1 < argc;
+        if (strcmp(argv[i], "--linhas") == 0 && tem_valor)
+            par.linhas = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--arquivos") == 0 && tem_valor)
+            par.arquivos = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cursos") == 0 && tem_valor)
+            par.cursos = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fracao-ads") == 0 && tem_valor)
+            par.fracao_ads = atof(argv[++i]);
+        else if (strcmp(argv[i], "--assimetria") == 0 && tem_valor)
+            par.assimetria = atof(argv[++i]);
+        else if (strcmp(argv[i], "--vazias") == 0 && tem_valor)
+            par.vazias = atof(argv[++i]);
+        else if (strcmp(argv[i], "--incompletas") == 0 && tem_valor)
+            par.incompletas = atof(argv[++i]);
+        else if (strcmp(argv[i], "--crlf") == 0)
+            par.crlf = 1;
+        else if (strcmp(argv[i], "--semente") == 0 && tem_valor)
+            par.semente = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--destino") == 0 && tem_valor)
+            par.destino = argv[++i];
+        else
+            uso(argv[0]);
+    }
+
+    if (par.linhas < 0 || par.arquivos < 1 || par.arquivos > TOTAL_ARQUIVOS || par.cursos < 2 ||
+        par.fracao_ads < 0.0 || par.fracao_ads > 1.0)
+    {
+        fprintf(stderr, "Erro: parâmetros inválidos (1 <= arquivos <= %d, cursos >= 2, 0 <= fracao-ads <= 1).\n", TOTAL_ARQUIVOS);
+        return 1;
+    }
+
+    // One course in 20 is ADS (at least one); codes start at 1000
+    int num_ads = par.cursos / 20 > 0 ? par.cursos / 20 : 1;
+    GrupoCursos ads, outros;
+    iniciar_grupo(&ads, 1000, num_ads, par.assimetria);
+    iniciar_grupo(&outros, 1000 + num_ads, par.cursos - num_ads, par.assimetria);
+
+    char diretorio[MAX_FILENAME];
+    snprintf(diretorio, sizeof(diretorio), "%s/2.DADOS", par.destino);
+    criar_diretorio(par.destino);
+    criar_diretorio(diretorio);
+
+    for (int a = 1; a <= par.arquivos; a++)
+    {
+        if (escrever_arquivo(&par, a, &ads, &outros) != 0)
+        {
+            fprintf(stderr, "Erro ao escrever o arquivo %d em %s\n", a, diretorio);
+            return 1;
+        }
+    }
+
+    printf("%lld linhas em %d arquivos gerados em %s\n", par.linhas, par.arquivos, diretorio);
+
+    free(ads.codigos);
+    free(ads.acumulada);
+    free(outros.codigos);
+    free(outros.acumulada);
+    return 0;
+}
@@ -1,414 +1,4600 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SCANNER_X86 1
+#endif
+
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+
+#ifdef COM_ZLIB
+#include <zlib.h>
+#endif
+#ifdef COM_ZSTD
+#include <zstd.h>
+#endif
+
+// 64-bit file offsets
+#ifndef _WIN32
+#define fseek64 fseeko
+#define ftell64 ftello
+#else
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#endif
+
 #define MAX_FILENAME 200
 #define TOTAL_ARQUIVOS 42
 #define MAX_COURSES 100000
+#define MAX_CODIGO_CURSO (1 << 27) // Larger CO_CURSO codes are malformed (the map stays under 16 MB)
+#define MAX_COLUNAS 512
+#define MAX_CATEGORIAS 7
+#define MAX_CRUZAMENTOS 8
+
+// Distinct ADS course codes, in ascending order (the same on every process)
+int cursos_ads[MAX_COURSES];
+int num_cursos_ads = 0;
+
+// Membership index of ADS courses: one bit per CO_CURSO code
+unsigned char *mapa_cursos_ads = NULL;
+int limite_mapa_cursos = 0; // Codes in [0, limite_mapa_cursos) fit in the map
+
+// Sets the bit of a course code, growing the map when needed.
+// Returns 1 if the course was not in the map yet; codes outside
+// [0, MAX_CODIGO_CURSO) are never marked.
+static int marcar_curso_ads(int co_curso)
+{
+    if (co_curso < 0 || co_curso >= MAX_CODIGO_CURSO)
+        return 0;
+
+    if (co_curso >= limite_mapa_cursos)
+    {
+        int novo_limite = limite_mapa_cursos > 0 ? limite_mapa_cursos : 1 << 16;
+        while (novo_limite <= co_curso)
+            novo_limite *= 2;
+
+        unsigned char *novo_mapa = realloc(mapa_cursos_ads, novo_limite / 8);
+        if (!novo_mapa)
+        {
+            fprintf(stderr, "Erro: memória insuficiente para o mapa de cursos ADS.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        memset(novo_mapa + limite_mapa_cursos / 8, 0, (novo_limite - limite_mapa_cursos) / 8);
+        mapa_cursos_ads = novo_mapa;
+        limite_mapa_cursos = novo_limite;
+    }
+
+    unsigned char bit = (unsigned char)(1u << (co_curso & 7));
+    if (mapa_cursos_ads[co_curso >> 3] & bit)
+        return 0;
+    mapa_cursos_ads[co_curso >> 3] |= bit;
+    return 1;
+}
+
+// Constant-time check of whether a course belongs to the ADS group
+static inline int curso_eh_ads(int co_curso)
+{
+    return (unsigned)co_curso < (unsigned)limite_mapa_cursos &&
+           (mapa_cursos_ads[co_curso >> 3] >> (co_curso & 7)) & 1;
+}
+
+static int comparar_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// --- Instrumentation ---
+// Each process times its phases with MPI_Wtime and counts the bytes and rows
+// they handle. With --metricas ARQ the values of all processes are gathered to
+// process 0 and written with min/max/mean per phase and the imbalance ratio
+// (max / mean). With mmap the file is read by page faults while it is counted,
+// so "leitura" only holds explicit reads (--mpi-io and --leitura-antecipada,
+// where it overlaps the counting).
+
+typedef enum
+{
+    FASE_CURSOS,     // ADS course extraction and merge
+    FASE_CABECALHOS, // Headers, column maps and stored results
+    FASE_LEITURA,    // Collective reads and row exchange
+    FASE_CONTAGEM,   // Tokenizing and counting
+    FASE_REDUCAO,    // Reduction of the counters
+    FASE_TOTAL,
+    NUM_FASES
+} Fase;
+
+static const char *nomes_fases[NUM_FASES] = {"cursos", "cabecalhos", "leitura", "contagem", "reducao", "total"};
+
+typedef struct
+{
+    double segundos[NUM_FASES];
+    long long bytes[NUM_FASES];
+    long long linhas[NUM_FASES];
+} Metricas;
+
+Metricas metricas; // Of this process
+
+// Adds time, bytes and rows to a phase; safe to call from several threads
+static void somar_fase(Fase fase, double segundos, long long bytes, long long linhas)
+{
+#ifdef _OPENMP
+#pragma omp critical(somar_fase)
+#endif
+    {
+        metricas.segundos[fase] += segundos;
+        metricas.bytes[fase] += bytes;
+        metricas.linhas[fase] += linhas;
+    }
+}
+
+// Read-only view of a whole input file (memory-mapped when possible)
+typedef struct
+{
+    const char *dados;
+    size_t tamanho;
+    int mapeado; // 1 if the view comes from mmap, 0 if it was read into memory
+} ArquivoMapeado;
+
+// One field of a row, pointing into the file without copying it
+typedef struct
+{
+    const char *inicio;
+    size_t tamanho;
+} Campo;
+
+// Maps a file into memory. Returns 0 on success and -1 if it cannot be opened.
+int mapear_arquivo(const char *filename, ArquivoMapeado *arq)
+{
+    arq->dados = NULL;
+    arq->tamanho = 0;
+    arq->mapeado = 0;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    arq->tamanho = (size_t)st.st_size;
+    if (arq->tamanho > 0)
+    {
+        void *p = mmap(NULL, arq->tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        madvise(p, arq->tamanho, MADV_SEQUENTIAL);
+        arq->dados = p;
+        arq->mapeado = 1;
+    }
+    close(fd);
+    return 0;
+#else
+    // Without mmap the whole file is read into a buffer
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    long tamanho = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char *buffer = malloc(tamanho > 0 ? (size_t)tamanho : 1);
+    if (!buffer)
+    {
+        fclose(fp);
+        return -1;
+    }
+    arq->tamanho = fread(buffer, 1, (size_t)tamanho, fp);
+    arq->dados = buffer;
+    fclose(fp);
+    return 0;
+#endif
+}
+
+void desmapear_arquivo(ArquivoMapeado *arq)
+{
+#ifndef _WIN32
+    if (arq->mapeado)
+        munmap((void *)arq->dados, arq->tamanho);
+    else
+#endif
+        free((void *)arq->dados);
+
+    arq->dados = NULL;
+    arq->tamanho = 0;
+}
+
+// --- Field boundary scanner ---
+// The input is scanned 64 bytes at a time, building one bitmask with the
+// positions of every ';' or '\n' and another with the '\n' only. Rows then
+// consume field boundaries by popping the lowest set bit of the masks.
+
+#define TAMANHO_BLOCO 64
+
+typedef struct
+{
+    const char *base; // Start of the current 64-byte block
+    const char *fim;
+    uint64_t sep;     // Pending ';' and '\n' positions of the block
+    uint64_t nl;      // Pending '\n' positions of the block
+} Scanner;
+
+typedef void (*FuncaoMascaras)(const char *bloco, uint64_t *sep, uint64_t *nl);
+
+// Builds the masks of up to 64 bytes one byte at a time
+static void mascaras_escalar_parcial(const char *bloco, size_t n, uint64_t *sep, uint64_t *nl)
+{
+    uint64_t s = 0, l = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (bloco[i] == '\n')
+            l |= 1ULL << i;
+        else if (bloco[i] != ';')
+            continue;
+        s |= 1ULL << i;
+    }
+    *sep = s;
+    *nl = l;
+}
+
+static void mascaras_escalar(const char *bloco, uint64_t *sep, uint64_t *nl)
+{
+    mascaras_escalar_parcial(bloco, TAMANHO_BLOCO, sep, nl);
+}
+
+#ifdef SCANNER_X86
+// SSE2 is part of the x86-64 baseline: four 16-byte compares per block
+static void mascaras_sse2(const char *bloco, uint64_t *sep, uint64_t *nl)
+{
+    const __m128i pv = _mm_set1_epi8(';');
+    const __m128i lf = _mm_set1_epi8('\n');
+    uint64_t s = 0, l = 0;
+
+    for (int i = 0; i < TAMANHO_BLOCO; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(bloco + i));
+        uint64_t m_pv = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, pv));
+        uint64_t m_lf = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+        s |= (m_pv | m_lf) << i;
+        l |= m_lf << i;
+    }
+    *sep = s;
+    *nl = l;
+}
+
+// AVX2: two 32-byte compares per block
+__attribute__((target("avx2"))) static void mascaras_avx2(const char *bloco, uint64_t *sep, uint64_t *nl)
+{
+    const __m256i pv = _mm256_set1_epi8(';');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    __m256i lo = _mm256_loadu_si256((const __m256i *)bloco);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(bloco + 32));
+
+    uint64_t lf_lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, lf));
+    uint64_t lf_hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, lf));
+    uint64_t pv_lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, pv));
+    uint64_t pv_hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, pv));
+
+    *nl = lf_lo | (lf_hi << 32);
+    *sep = *nl | pv_lo | (pv_hi << 32);
+}
+#endif
+
+static FuncaoMascaras mascaras_bloco = NULL;
+
+// Selects the widest kernel supported by the CPU (once per process)
+static void selecionar_kernel_scanner(void)
+{
+    mascaras_bloco = mascaras_escalar;
+#ifdef SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        mascaras_bloco = mascaras_avx2;
+    else
+        mascaras_bloco = mascaras_sse2;
+#endif
+}
+
+// Computes the masks of the block at s->base; the last partial block is
+// handled byte by byte so nothing past the end of the file is read
+static void scanner_carregar(Scanner *s)
+{
+    if ((size_t)(s->fim - s->base) >= TAMANHO_BLOCO)
+        mascaras_bloco(s->base, &s->sep, &s->nl);
+    else
+        mascaras_escalar_parcial(s->base, (size_t)(s->fim - s->base), &s->sep, &s->nl);
+}
+
+static void scanner_iniciar(Scanner *s, const char *inicio, const char *fim)
+{
+    if (!mascaras_bloco)
+        selecionar_kernel_scanner();
+
+    s->base = inicio;
+    s->fim = fim;
+    s->sep = s->nl = 0;
+    if (inicio < fim)
+        scanner_carregar(s);
+}
+
+// Moves to the next block; returns 0 at the end of the input
+static int scanner_avancar(Scanner *s)
+{
+    s->base += TAMANHO_BLOCO;
+    if (s->base >= s->fim)
+    {
+        s->base = s->fim;
+        return 0;
+    }
+    scanner_carregar(s);
+    return 1;
+}
+
+// Returns the next ';' or '\n', or fim if there is none
+static inline const char *scanner_proximo_separador(Scanner *s)
+{
+    while (s->sep == 0)
+    {
+        if (!scanner_avancar(s))
+            return s->fim;
+    }
+
+    int bit = __builtin_ctzll(s->sep);
+    s->sep &= s->sep - 1;
+    s->nl &= ~((2ULL << bit) - 1); // Drops newlines at or before this position
+    return s->base + bit;
+}
+
+// Skips the rest of the current line; returns the start of the next one
+static inline const char *scanner_proxima_linha(Scanner *s)
+{
+    while (s->nl == 0)
+    {
+        if (!scanner_avancar(s))
+            return s->fim;
+    }
+
+    int bit = __builtin_ctzll(s->nl);
+    s->nl &= s->nl - 1;
+    s->sep &= ~((2ULL << bit) - 1);
+    return s->base + bit + 1;
+}
+
+// Walks the fields of the row that starts at p, in place, taking the field
+// boundaries from the scanner. Fields 1..max_coluna are stored in
+// campos[1..max_coluna]; the walk stops at the last needed field and jumps
+// straight to the next line, set in *proxima_linha.
+// Returns the number of columns seen, capped at max_coluna.
+static int ler_campos(Scanner *s, const char *p, int max_coluna, Campo *campos, const char **proxima_linha)
+{
+    int col = 0;
+
+    while (col < max_coluna)
+    {
+        const char *sep = scanner_proximo_separador(s);
+
+        col++;
+        campos[col].inicio = p;
+        campos[col].tamanho = (size_t)(sep - p);
+
+        if (sep >= s->fim || *sep == '\n')
+        {
+            *proxima_linha = sep < s->fim ? sep + 1 : s->fim;
+            return col;
+        }
+        p = sep + 1; // Skips the ';'
+    }
+
+    *proxima_linha = scanner_proxima_linha(s);
+    return col;
+}
+
+// Removes a trailing carriage return and surrounding quotes from a field
+static Campo limpar_campo(Campo c)
+{
+    if (c.tamanho > 0 && c.inicio[c.tamanho - 1] == '\r')
+        c.tamanho--;
+    if (c.tamanho > 0 && c.inicio[0] == '"')
+    {
+        c.inicio++;
+        c.tamanho--;
+    }
+    if (c.tamanho > 0 && c.inicio[c.tamanho - 1] == '"')
+        c.tamanho--;
+    return c;
+}
+
+static int campo_igual(Campo c, const char *texto)
+{
+    return c.tamanho == strlen(texto) && memcmp(c.inicio, texto, c.tamanho) == 0;
+}
+
+// Parses the leading integer of a field (same behavior as atoi)
+static int campo_para_int(Campo c)
+{
+    const char *p = c.inicio, *fim = c.inicio + c.tamanho;
+    int sinal = 1, valor = 0;
+
+    while (p < fim && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p < fim && (*p == '-' || *p == '+'))
+        sinal = *p++ == '-' ? -1 : 1;
+    while (p < fim && *p >= '0' && *p <= '9')
+        valor = valor * 10 + (*p++ - '0');
+
+    return sinal * valor;
+}
+
+// Parses a decimal number such as "57,3" (comma or point as the separator).
+// The digits are read as an integer and divided by a power of ten, so equal
+// decimals always give the same double. Returns -1 if the field is not a number.
+static int campo_para_decimal(Campo c, double *valor)
+{
+    static const double potencias[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+    const char *p = c.inicio, *fim = c.inicio + c.tamanho;
+    long long mantissa = 0;
+    int sinal = 1, digitos = 0, decimais = -1;
+
+    if (p < fim && (*p == '-' || *p == '+'))
+        sinal = *p++ == '-' ? -1 : 1;
+    for (; p < fim; p++)
+    {
+        if ((*p == ',' || *p == '.') && decimais == -1)
+            decimais = 0;
+        else if (*p >= '0' && *p <= '9' && digitos < 15 && decimais < 9)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digitos++;
+            if (decimais >= 0)
+                decimais++;
+        }
+        else if (*p < '0' || *p > '9')
+            return -1;
+    }
+    if (digitos == 0)
+        return -1;
+
+    *valor = sinal * (double)mantissa / potencias[decimais > 0 ? decimais : 0];
+    return 0;
+}
+
+// Returns the start of the first row that begins at or after offset inicio.
+// Ranges that do not start at a row boundary begin at the next row.
+static const char *inicio_de_linha(const ArquivoMapeado *arq, long long inicio_dados, long long inicio)
+{
+    const char *p = arq->dados + inicio;
+    const char *fim = arq->dados + arq->tamanho;
+
+    if (inicio > inicio_dados && p[-1] != '\n')
+    {
+        const char *nl = memchr(p, '\n', (size_t)(fim - p));
+        p = nl ? nl + 1 : fim;
+    }
+    return p;
+}
+
+// Collects the ADS courses (group 72) of the rows of the courses file that
+// start in [p, fim); the scanner must reach the end of the last row. Returns
+// the number of incomplete lines ignored.
+static int extrair_cursos_linhas(Scanner *scanner, const char *p, const char *fim, long long *linhas)
+{
+    int linhas_ignoradas_ads = 0; // Renamed to avoid confusion with other ignored lines
+    Campo campos[7];
+
+    while (p < fim)
+    {
+        // We need columns 2 (CO_CURSO) and 6 (CO_GRUPO)
+        int num_colunas = ler_campos(scanner, p, 6, campos, &p);
+        (*linhas)++;
+        if (num_colunas < 6)
+        {
+            linhas_ignoradas_ads++;
+            continue; // Ignores incomplete lines
+        }
+
+        int co_curso = campo_para_int(limpar_campo(campos[2]));
+        int co_grupo = campo_para_int(limpar_campo(campos[6]));
+
+        // Each course is stored once, no matter how many students it has
+        if (co_grupo == 72 && num_cursos_ads < MAX_COURSES && marcar_curso_ads(co_curso))
+        {
+            cursos_ads[num_cursos_ads++] = co_curso;
+        }
+    }
+    return linhas_ignoradas_ads;
+}
+
+// Extracts ADS courses (group 72) from the first file. Each process scans an
+// equal share of its rows; unir_cursos_ads() then merges the courses found.
+// Returns the number of incomplete lines ignored by this process.
+int extrair_cursos_ads(const char *filename, int rank, int size)
+{
+    ArquivoMapeado arq;
+    if (mapear_arquivo(filename, &arq) != 0)
+    {
+        fprintf(stderr, "Rank %d: Erro ao abrir %s para extrair cursos ADS.\n", rank, filename);
+        return 0;
+    }
+
+    const char *fim_arquivo = arq.dados + arq.tamanho;
+    Scanner scanner;
+    scanner_iniciar(&scanner, arq.dados, fim_arquivo);
+    const char *p = scanner_proxima_linha(&scanner); // Skips the header
+
+    long long inicio_dados = (long long)(p - arq.dados);
+    long long dados = (long long)arq.tamanho - inicio_dados;
+    const char *fim = arq.dados + inicio_dados + dados * (rank + 1) / size;
+    p = inicio_de_linha(&arq, inicio_dados, inicio_dados + dados * rank / size);
+    scanner_iniciar(&scanner, p, fim_arquivo);
+
+    long long linhas = 0;
+    int linhas_ignoradas_ads = extrair_cursos_linhas(&scanner, p, fim, &linhas);
+
+    somar_fase(FASE_CURSOS, 0.0, fim > p ? (long long)(fim - p) : 0, linhas);
+    desmapear_arquivo(&arq);
+    return linhas_ignoradas_ads;
+}
+
+// Collective: gathers the courses found by every process, so that all of them
+// end up with the same deduplicated and sorted set (list and membership map)
+void unir_cursos_ads(int size)
+{
+    int *contagens = malloc(size * sizeof(int));
+    int *deslocamentos = malloc(size * sizeof(int));
+    int total = 0;
+
+    MPI_Allgather(&num_cursos_ads, 1, MPI_INT, contagens, 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r = 0; r < size; r++)
+    {
+        deslocamentos[r] = total;
+        total += contagens[r];
+    }
+
+    int *todos = malloc((total > 0 ? total : 1) * sizeof(int));
+    MPI_Allgatherv(cursos_ads, num_cursos_ads, MPI_INT, todos, contagens, deslocamentos, MPI_INT, MPI_COMM_WORLD);
+
+    // The local courses are already in the map; only new ones are appended
+    for (int i = 0; i < total; i++)
+    {
+        if (num_cursos_ads < MAX_COURSES && marcar_curso_ads(todos[i]))
+            cursos_ads[num_cursos_ads++] = todos[i];
+    }
+    qsort(cursos_ads, num_cursos_ads, sizeof(int), comparar_int);
+
+    free(todos);
+    free(deslocamentos);
+    free(contagens);
+}
+
+// Questions analyzed in a single pass over each file
+enum
+{
+    Q_I15,
+    Q_I22,
+    Q_I23,
+    Q_SEXO,
+    Q_I18,
+    Q_I19,
+    Q_I21,
+    Q_PR_GER,
+    NUM_QUESTOES
+};
+
+// How the raw response of a question is mapped to a counter index
+typedef enum
+{
+    TIPO_LETRA, // A, B, C, ... -> 0, 1, 2, ...
+    TIPO_SEXO,  // M, F -> 0, 1
+    TIPO_PR_GER // 222, 333, 444, 555, 556 -> 0..4
+} TipoQuestao;
+
+typedef struct
+{
+    const char *nome; // Column name in the header
+    TipoQuestao tipo;
+    int num_categorias;
+} Questao;
+
+static const Questao questoes[NUM_QUESTOES] = {
+    {"QE_I15", TIPO_LETRA, 6},    // A-F
+    {"QE_I22", TIPO_LETRA, 5},    // A-E
+    {"QE_I23", TIPO_LETRA, 5},    // A-E
+    {"TP_SEXO", TIPO_SEXO, 2},    // M, F
+    {"QE_I18", TIPO_LETRA, 5},    // A-E
+    {"QE_I19", TIPO_LETRA, 7},    // A-G
+    {"QE_I21", TIPO_LETRA, 2},    // A, B
+    {"TP_PR_GER", TIPO_PR_GER, 5} // 222, 333, 444, 555, 556
+};
+
+// A cross-tabulation between two questions (--cruzar A:B): a dense matrix of
+// ADS students by category of A (rows) and category of B (columns), filled in
+// the same scan that counts the questions
+typedef struct
+{
+    int questao_a, questao_b; // Indices in questoes[]
+    int arquivo_a, arquivo_b; // File holding each column, or -1 if the pair cannot be counted
+} Cruzamento;
+
+Cruzamento cruzamentos[MAX_CRUZAMENTOS];
+int num_cruzamentos = 0;
+
+// --- Score summaries ---
+// The numeric scores (NT_GER, NT_FG) of the ADS students are summarized during
+// the same scan, with summaries of fixed size that can be merged in any order:
+// count, mean and sum of squared deviations (Welford, merged with Chan's
+// formula), minimum and maximum, a histogram of fixed bins and a KLL sketch
+// for quantiles. Merging the summaries of all processes costs the same
+// communication whatever the number of rows.
+
+enum
+{
+    N_GER,
+    N_FG,
+    NUM_NOTAS
+};
+
+static const char *nomes_notas[NUM_NOTAS] = {"NT_GER", "NT_FG"};
+
+#define NOTA_MAXIMA 100.0
+#define NUM_FAIXAS_NOTA 20 // Histogram bins of 5 points over [0, 100]
+
+// KLL sketch (Karnin, Lang and Liberty): level h holds items that stand for
+// 2^h values each. A full level is sorted and every other item (odd or even
+// positions, by a coin flip) moves up a level; level capacities shrink by 2/3
+// going down from the top one. With k = 200 the rank error of a quantile is
+// below 1%. The levels are stored from the top one down, so new values are
+// appended at the end.
+#define KLL_K 200
+#define KLL_MAX_NIVEIS 40
+#define KLL_MAX_ITENS (3 * KLL_K + 2 * KLL_MAX_NIVEIS)
+
+typedef struct
+{
+    int num_niveis;
+    int num_itens;
+    int capacidade;              // Sum of the capacities of the levels
+    int tamanho[KLL_MAX_NIVEIS]; // Items held by each level
+    unsigned long long moeda;    // State of the coin flips (splitmix64)
+    double itens[KLL_MAX_ITENS];
+} SketchKLL;
+
+typedef struct
+{
+    long long n;         // Valid scores
+    long long vazio;     // Empty scores (absent students, among others)
+    long long invalidas; // Scores that are not numbers
+    long long ignoradas; // Lines too short for the score
+    double media, m2;    // Mean and sum of squared deviations from it
+    double min, max;
+    long long faixas[NUM_FAIXAS_NOTA];
+    SketchKLL quantis;
+} ResumoNota;
+
+// Capacity of level h of a sketch: ceil(k * (2/3)^(top - h)), at least 2
+static int capacidade_nivel(const SketchKLL *s, int h)
+{
+    double capacidade = KLL_K;
+    for (int i = h + 1; i < s->num_niveis; i++)
+        capacidade *= 2.0 / 3.0;
+    int inteira = (int)capacidade + ((double)(int)capacidade < capacidade);
+    return inteira > 2 ? inteira : 2;
+}
+
+// Adds an empty top level, stored before all others
+static void crescer_sketch(SketchKLL *s)
+{
+    s->tamanho[s->num_niveis++] = 0;
+    s->capacidade = 0;
+    for (int h = 0; h < s->num_niveis; h++)
+        s->capacidade += capacidade_nivel(s, h);
+}
+
+// Offset of the first item of level h (the levels above it come first)
+static int inicio_nivel(const SketchKLL *s, int h)
+{
+    int inicio = 0;
+    for (int i = s->num_niveis - 1; i > h; i--)
+        inicio += s->tamanho[i];
+    return inicio;
+}
+
+static int comparar_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Moves half of the items of level h up one level; with an odd count, the
+// smallest one stays
+static void compactar_nivel(SketchKLL *s, int h)
+{
+    if (h + 1 == s->num_niveis)
+        crescer_sketch(s);
+
+    int inicio = inicio_nivel(s, h), m = s->tamanho[h];
+    double *nivel = s->itens + inicio;
+    qsort(nivel, m, sizeof(double), comparar_double);
+
+    unsigned long long z = (s->moeda += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    int deslocamento = (int)((z ^ (z >> 31)) & 1);
+
+    // Level h + 1 ends where level h starts, so the promoted items are written
+    // in place and the lower levels move down to close the gap
+    int resto = m % 2, promovidos = m / 2;
+    double menor = nivel[0];
+    for (int j = 0; j < promovidos; j++)
+        nivel[j] = nivel[resto + 2 * j + deslocamento];
+    if (resto)
+        nivel[promovidos] = menor;
+
+    int fim = inicio + m;
+    memmove(nivel + promovidos + resto, s->itens + fim, (s->num_itens - fim) * sizeof(double));
+    s->tamanho[h + 1] += promovidos;
+    s->tamanho[h] = resto;
+    s->num_itens -= promovidos;
+}
+
+// Compacts the lowest full levels until the sketch is below its total capacity
+static void comprimir_sketch(SketchKLL *s)
+{
+    while (s->num_itens >= s->capacidade && s->num_niveis < KLL_MAX_NIVEIS)
+    {
+        for (int h = 0; h < s->num_niveis; h++)
+        {
+            if (s->tamanho[h] >= capacidade_nivel(s, h))
+            {
+                compactar_nivel(s, h);
+                break;
+            }
+        }
+    }
+}
+
+// Adds an item to level h
+static void inserir_sketch(SketchKLL *s, int h, double valor)
+{
+    while (h >= s->num_niveis)
+        crescer_sketch(s);
+
+    // Level 0 is the last one stored
+    int fim = h == 0 ? s->num_itens : inicio_nivel(s, h) + s->tamanho[h];
+    memmove(s->itens + fim + 1, s->itens + fim, (s->num_itens - fim) * sizeof(double));
+    s->itens[fim] = valor;
+    s->tamanho[h]++;
+    s->num_itens++;
+    comprimir_sketch(s);
+}
+
+// Merges the items of origem into destino, level by level
+static void unir_sketches(SketchKLL *destino, const SketchKLL *origem)
+{
+    int inicio = 0;
+    for (int h = origem->num_niveis - 1; h >= 0; h--)
+    {
+        for (int i = 0; i < origem->tamanho[h]; i++)
+            inserir_sketch(destino, h, origem->itens[inicio + i]);
+        inicio += origem->tamanho[h];
+    }
+}
+
+// Value at quantile q (0 to 1) of the values summarized by the sketch
+static double quantil_sketch(const SketchKLL *s, double q)
+{
+    double(*pares)[2] = malloc((s->num_itens > 0 ? s->num_itens : 1) * sizeof(*pares));
+    double total = 0.0;
+    int k = 0;
+    for (int h = s->num_niveis - 1; h >= 0; h--)
+    {
+        double peso = (double)(1ULL << h);
+        for (int i = 0; i < s->tamanho[h]; i++, k++)
+        {
+            pares[k][0] = s->itens[k];
+            pares[k][1] = peso;
+            total += peso;
+        }
+    }
+    qsort(pares, k, sizeof(*pares), comparar_double);
+
+    double acumulado = 0.0, valor = k > 0 ? pares[k - 1][0] : 0.0;
+    for (int i = 0; i < k; i++)
+    {
+        acumulado += pares[i][1];
+        if (acumulado >= q * total)
+        {
+            valor = pares[i][0];
+            break;
+        }
+    }
+    free(pares);
+    return valor;
+}
+
+// Adds a valid score to a summary
+static void adicionar_nota(ResumoNota *r, double valor)
+{
+    r->n++;
+    double delta = valor - r->media;
+    r->media += delta / r->n;
+    r->m2 += delta * (valor - r->media);
+    if (r->n == 1 || valor < r->min)
+        r->min = valor;
+    if (r->n == 1 || valor > r->max)
+        r->max = valor;
+
+    int faixa = (int)(valor * NUM_FAIXAS_NOTA / NOTA_MAXIMA);
+    if (faixa < 0)
+        faixa = 0;
+    if (faixa >= NUM_FAIXAS_NOTA)
+        faixa = NUM_FAIXAS_NOTA - 1;
+    r->faixas[faixa]++;
+
+    inserir_sketch(&r->quantis, 0, valor);
+}
+
+// Merges the summary origem into destino
+static void unir_resumos(ResumoNota *destino, const ResumoNota *origem)
+{
+    destino->vazio += origem->vazio;
+    destino->invalidas += origem->invalidas;
+    destino->ignoradas += origem->ignoradas;
+    for (int f = 0; f < NUM_FAIXAS_NOTA; f++)
+        destino->faixas[f] += origem->faixas[f];
+    if (origem->n == 0)
+        return;
+
+    if (destino->n == 0)
+    {
+        destino->min = origem->min;
+        destino->max = origem->max;
+    }
+    else
+    {
+        if (origem->min < destino->min)
+            destino->min = origem->min;
+        if (origem->max > destino->max)
+            destino->max = origem->max;
+    }
+
+    long long n = destino->n + origem->n;
+    double delta = origem->media - destino->media;
+    destino->media += delta * origem->n / n;
+    destino->m2 += origem->m2 + delta * delta * ((double)destino->n * origem->n / n);
+    destino->n = n;
+
+    unir_sketches(&destino->quantis, &origem->quantis);
+}
+
+// Counters of one question: categories, empty responses and ignored incomplete lines
+typedef struct
+{
+    long long contadores[MAX_CATEGORIAS];
+    long long vazio;
+    long long ignoradas;
+} ContadoresQuestao;
+
+// All counters of a rank (or thread): NUM_CONTADORES contiguous 64-bit
+// counters followed by the score summaries. They are combined by one
+// reduction with the MPI_Op of criar_reducao_resultados().
+typedef struct
+{
+    ContadoresQuestao questoes[NUM_QUESTOES];
+    long long total_alunos_ads; // ADS students analyzed, counted once per line of QE_I15
+    long long cruzamentos[MAX_CRUZAMENTOS][MAX_CATEGORIAS][MAX_CATEGORIAS];
+    ResumoNota notas[NUM_NOTAS];
+} Resultados;
+
+#define NUM_CONTADORES ((int)(offsetof(Resultados, notas) / sizeof(long long)))
+
+// Adds the counters of origem to destino and merges the score summaries
+static void somar_resultados(Resultados *destino, const Resultados *origem)
+{
+    const long long *o = (const long long *)origem;
+    long long *d = (long long *)destino;
+
+    for (int i = 0; i < NUM_CONTADORES; i++)
+        d[i] += o[i];
+    for (int n = 0; n < NUM_NOTAS; n++)
+        unir_resumos(&destino->notas[n], &origem->notas[n]);
+}
+
+static void somar_resultados_mpi(void *entrada, void *saida, int *n, MPI_Datatype *tipo)
+{
+    (void)tipo;
+    for (int i = 0; i < *n; i++)
+        somar_resultados((Resultados *)saida + i, (const Resultados *)entrada + i);
+}
+
+// Datatype and operation that reduce arrays of Resultados
+static void criar_reducao_resultados(MPI_Datatype *tipo, MPI_Op *op)
+{
+    MPI_Type_contiguous(sizeof(Resultados), MPI_BYTE, tipo);
+    MPI_Type_commit(tipo);
+    MPI_Op_create(somar_resultados_mpi, 1, op);
+}
+
+// Maps a cleaned response to its counter index, or -1 if it matches no category
+static int categoria_resposta(const Questao *q, Campo resposta)
+{
+    int categoria = -1;
+
+    switch (q->tipo)
+    {
+    case TIPO_SEXO:
+        if (campo_igual(resposta, "M"))
+            categoria = 0;
+        else if (campo_igual(resposta, "F"))
+            categoria = 1;
+        break;
+    case TIPO_PR_GER:
+        switch (campo_para_int(resposta))
+        {
+        case 222:
+            categoria = 0;
+            break;
+        case 333:
+            categoria = 1;
+            break;
+        case 444:
+            categoria = 2;
+            break;
+        case 555:
+            categoria = 3;
+            break;
+        case 556:
+            categoria = 4;
+            break;
+        }
+        break;
+    case TIPO_LETRA:
+        if (resposta.inicio[0] >= 'A' && resposta.inicio[0] <= 'Z')
+            categoria = resposta.inicio[0] - 'A';
+        break;
+    }
+
+    return categoria < q->num_categorias ? categoria : -1;
+}
+
+// How an input file is read (see "Compressed inputs" below)
+typedef enum
+{
+    FORMATO_TEXTO, // Plain text file, split in byte ranges
+    FORMATO_GZIP,  // .txt.gz next to the text file
+    FORMATO_ZIP,   // Member of the --zip archive (stored or DEFLATE)
+    FORMATO_ZSTD   // .txt.zst next to the text file
+} Formato;
+
+typedef struct
+{
+    Formato formato;
+    int metodo;             // Zip member: 0 stored, 8 DEFLATE
+    long long deslocamento; // Zip member: offset of its compressed data
+    long long tamanho;      // Compressed bytes
+    unsigned crc;           // Zip member: CRC-32 of its contents
+} Entrada;
+
+// Column layout of an input file, read once from its header and shared with
+// every chunk of the file
+typedef struct
+{
+    int idx_questao[NUM_QUESTOES]; // Column (1-based) of each question, or -1
+    int idx_nota[NUM_NOTAS];       // Column of each score, or -1
+    int idx_co_curso;
+    int max_coluna;                // Last column needed from each row
+    long long inicio_dados;        // Offset of the first data row
+    long long tamanho;             // Size of the file; 0 if it has nothing to count
+    int em_cache;                  // Counted from the columnar cache (see below)
+    int bytes_por_linha;           // Cache only: bytes read per row
+    long long num_linhas;          // Cache only: number of rows
+    unsigned cruzamentos;          // Bit c set if this file drives cruzamentos[c]
+    Entrada entrada;               // Compressed files are counted whole, as one chunk
+} MapaColunas;
+
+// A byte range of an input file. Rows that start inside the range belong to it.
+typedef struct
+{
+    int arquivo;
+    long long inicio;
+    long long fim;
+} Bloco;
+
+// Finds the columns of the questions, of the scores and of CO_CURSO in the
+// header row at the start of `dados` and sets inicio_dados. Returns 1 if the
+// file has something to count.
+static int interpretar_cabecalho(const char *filename, const char *dados, size_t tamanho, MapaColunas *mapa)
+{
+    memset(mapa, 0, sizeof(*mapa));
+    mapa->idx_co_curso = -1;
+    for (int q = 0; q < NUM_QUESTOES; q++)
+        mapa->idx_questao[q] = -1;
+    for (int n = 0; n < NUM_NOTAS; n++)
+        mapa->idx_nota[n] = -1;
+
+    const char *p = dados;
+    Scanner scanner;
+    scanner_iniciar(&scanner, p, dados + tamanho);
+    Campo campos[MAX_COLUNAS + 1];
+    int num_presentes = 0;
+
+    int num_cabecalho = ler_campos(&scanner, p, MAX_COLUNAS, campos, &p);
+    for (int col = 1; col <= num_cabecalho; col++)
+    {
+        Campo nome = limpar_campo(campos[col]);
+
+        for (int q = 0; q < NUM_QUESTOES; q++)
+        {
+            if (mapa->idx_questao[q] == -1 && campo_igual(nome, questoes[q].nome))
+            {
+                mapa->idx_questao[q] = col;
+                num_presentes++;
+                if (col > mapa->max_coluna)
+                    mapa->max_coluna = col;
+            }
+        }
+        for (int n = 0; n < NUM_NOTAS; n++)
+        {
+            if (mapa->idx_nota[n] == -1 && campo_igual(nome, nomes_notas[n]))
+            {
+                mapa->idx_nota[n] = col;
+                num_presentes++;
+                if (col > mapa->max_coluna)
+                    mapa->max_coluna = col;
+            }
+        }
+        if (campo_igual(nome, "CO_CURSO"))
+        {
+            mapa->idx_co_curso = col;
+        }
+    }
+
+    // Files without any of the questions or scores are not scanned
+    if (num_presentes == 0)
+        return 0;
+
+    // Check if CO_CURSO is found. It's essential for filtering.
+    if (mapa->idx_co_curso == -1)
+    {
+        fprintf(stderr, "Aviso: Coluna 'CO_CURSO' não encontrada no cabeçalho de %s. Arquivo ignorado.\n", filename);
+        return 0;
+    }
+
+    if (mapa->idx_co_curso > mapa->max_coluna)
+        mapa->max_coluna = mapa->idx_co_curso;
+    mapa->inicio_dados = (long long)(p - dados);
+    return 1;
+}
+
+// Reads the header of a file to find the columns of all questions at once.
+// Files without any of the questions (or without CO_CURSO) get tamanho = 0.
+void ler_cabecalho(const char *filename, MapaColunas *mapa)
+{
+    ArquivoMapeado arq;
+    if (mapear_arquivo(filename, &arq) != 0)
+    {
+        memset(mapa, 0, sizeof(*mapa));
+        fprintf(stderr, "Erro ao abrir %s\n", filename);
+        return;
+    }
+
+    if (interpretar_cabecalho(filename, arq.dados, arq.tamanho, mapa))
+        mapa->tamanho = (long long)arq.tamanho;
+
+    desmapear_arquivo(&arq);
+}
+
+// Splits the data of all files into byte ranges and returns the ones of this rank.
+// The combined input is divided into equal shares of bytes, one per rank, and each
+// share is cut at file boundaries and into chunks of at most tamanho_bloco bytes.
+// Chunks are made smaller if needed so that the share has at least min_blocos
+// chunks (one per thread that will count it).
+int dividir_blocos(const MapaColunas *mapas, int num_arquivos, int rank, int size, long long tamanho_bloco, int min_blocos, Bloco **blocos)
+{
+    long long total = 0;
+    for (int i = 0; i < num_arquivos; i++)
+        if (mapas[i].tamanho > 0)
+            total += mapas[i].tamanho - mapas[i].inicio_dados;
+
+    long long inicio_rank = total * rank / size;
+    long long fim_rank = total * (rank + 1) / size;
+
+    long long tamanho_minimo = (fim_rank - inicio_rank + min_blocos - 1) / min_blocos;
+    if (tamanho_minimo > 0 && tamanho_minimo < tamanho_bloco)
+        tamanho_bloco = tamanho_minimo;
+
+    int capacidade = 16, num_blocos = 0;
+    *blocos = malloc(capacidade * sizeof(Bloco));
+
+    long long deslocamento = 0; // Offset of the current file in the combined input
+    for (int i = 0; i < num_arquivos && deslocamento < fim_rank; i++)
+    {
+        if (mapas[i].tamanho <= 0)
+            continue;
+
+        long long dados = mapas[i].tamanho - mapas[i].inicio_dados;
+
+        // A compressed file cannot be split: it goes whole to the process whose
+        // range holds its first byte
+        if (mapas[i].entrada.formato != FORMATO_TEXTO)
+        {
+            if (deslocamento >= inicio_rank)
+            {
+                if (num_blocos == capacidade)
+                {
+                    capacidade *= 2;
+                    *blocos = realloc(*blocos, capacidade * sizeof(Bloco));
+                }
+                (*blocos)[num_blocos++] = (Bloco){i, mapas[i].inicio_dados, mapas[i].tamanho};
+            }
+            deslocamento += dados;
+            continue;
+        }
+
+        long long ini = inicio_rank > deslocamento ? inicio_rank : deslocamento;
+        long long fim = fim_rank < deslocamento + dados ? fim_rank : deslocamento + dados;
+
+        for (long long b = ini; b < fim; b += tamanho_bloco)
+        {
+            if (num_blocos == capacidade)
+            {
+                capacidade *= 2;
+                *blocos = realloc(*blocos, capacidade * sizeof(Bloco));
+            }
+            Bloco *bloco = &(*blocos)[num_blocos++];
+            bloco->arquivo = i;
+            bloco->inicio = mapas[i].inicio_dados + (b - deslocamento);
+            bloco->fim = mapas[i].inicio_dados + ((b + tamanho_bloco < fim ? b + tamanho_bloco : fim) - deslocamento);
+        }
+
+        deslocamento += dados;
+    }
+
+    return num_blocos;
+}
+
+// Counts the responses of every question in the rows that start inside
+// [inicio, fim) of a mapped file. The range is snapped to the next newline, so a
+// row cut by a chunk boundary is counted by the chunk where it starts. Each row is
+// walked once, in place, up to the last needed column, and updates the counters
+// of all questions and the total of ADS students. Returns the rows read.
+long long contar_respostas(const ArquivoMapeado *arq, const MapaColunas *mapa, long long inicio, long long fim, Resultados *resultados)
+{
+    const char *fim_arquivo = arq->dados + arq->tamanho;
+    const char *p = inicio_de_linha(arq, mapa->inicio_dados, inicio);
+    const char *fim_bloco = arq->dados + fim;
+
+    Scanner scanner;
+    scanner_iniciar(&scanner, p, fim_arquivo);
+    Campo campos[MAX_COLUNAS + 1];
+    ContadoresQuestao *contadores = resultados->questoes;
+    const int idx_co_curso = mapa->idx_co_curso;
+    long long linhas = 0;
+
+    // Reads data lines
+    while (p < fim_bloco)
+    {
+        int num_colunas = ler_campos(&scanner, p, mapa->max_coluna, campos, &p);
+        linhas++;
+
+        // Checks if the course is valid (is among the extracted ADS courses)
+        int curso_valido = num_colunas >= idx_co_curso &&
+                           curso_eh_ads(campo_para_int(limpar_campo(campos[idx_co_curso])));
+        int categoria_linha[NUM_QUESTOES]; // Category of each answer of the row, or -1
+
+        for (int q = 0; q < NUM_QUESTOES; q++)
+        {
+            categoria_linha[q] = -1;
+            if (mapa->idx_questao[q] == -1)
+                continue;
+
+            // The line must have at least the course and question columns
+            if (num_colunas < mapa->idx_questao[q] || num_colunas < idx_co_curso)
+            {
+                contadores[q].ignoradas++;
+                continue;
+            }
+
+            // If it is an ADS student, process the response
+            if (!curso_valido)
+                continue;
+
+            // The total of ADS students is counted once per line of the reference question
+            if (q == Q_I15)
+                resultados->total_alunos_ads++;
+
+            Campo resposta = limpar_campo(campos[mapa->idx_questao[q]]);
+            if (resposta.tamanho == 0)
+            {
+                contadores[q].vazio++;
+            }
+            else
+            {
+                int categoria = categoria_resposta(&questoes[q], resposta);
+                if (categoria >= 0)
+                    contadores[q].contadores[categoria]++;
+                categoria_linha[q] = categoria;
+            }
+        }
+
+        // Cross-tabulations of two questions of this file
+        for (unsigned pendentes = mapa->cruzamentos; pendentes; pendentes &= pendentes - 1)
+        {
+            const Cruzamento *c = &cruzamentos[__builtin_ctz(pendentes)];
+            int a = categoria_linha[c->questao_a], b = categoria_linha[c->questao_b];
+            if (a >= 0 && b >= 0)
+                resultados->cruzamentos[c - cruzamentos][a][b]++;
+        }
+
+        // Scores, with the same rules as the questions
+        for (int n = 0; n < NUM_NOTAS; n++)
+        {
+            int idx = mapa->idx_nota[n];
+            if (idx == -1)
+                continue;
+
+            ResumoNota *nota = &resultados->notas[n];
+            if (num_colunas < idx || num_colunas < idx_co_curso)
+            {
+                nota->ignoradas++;
+                continue;
+            }
+            if (!curso_valido)
+                continue;
+
+            Campo campo = limpar_campo(campos[idx]);
+            double valor;
+            if (campo.tamanho == 0)
+                nota->vazio++;
+            else if (campo_para_decimal(campo, &valor) != 0)
+                nota->invalidas++;
+            else
+                adicionar_nota(nota, valor);
+        }
+    }
+    return linhas;
+}
+
+// --- Columnar cache ---
+// Optional binary copy of the columns used by the analysis, written once by
+// --gerar-cache and read with --cache. Each input file gets one cache file:
+// a fixed header with the row count and the directory of columns, followed by
+// each column stored contiguously and aligned to a page, so a run only touches
+// the pages of the columns it needs. CO_CURSO (and CO_GRUPO for the courses
+// file) are stored as int32; each question is stored as one byte holding its
+// category index or one of the codes below; each score as an int32 number of
+// hundredths of a point.
+
+#define CACHE_MAGICA "ENADECL"
+#define CACHE_VERSAO 2
+#define CACHE_ALINHAMENTO 4096
+#define CACHE_MAX_COLUNAS (NUM_QUESTOES + NUM_NOTAS + 2)
+
+#define CACHE_VAZIO 0xFD    // Empty response
+#define CACHE_INVALIDO 0xFE // Response outside the categories of the question
+#define CACHE_AUSENTE 0xFF  // Line too short for the question (incomplete)
+#define CACHE_SEM_VALOR INT32_MIN
+#define CACHE_NOTA_VAZIA (INT32_MIN + 1)    // Empty score
+#define CACHE_NOTA_INVALIDA (INT32_MIN + 2) // Score that is not a number
+
+typedef struct
+{
+    char nome[16];
+    int bytes_por_valor; // 4 for int32 codes, 1 for responses
+    int questao;         // Index in questoes[], or -1
+    long long deslocamento;
+} ColunaCache;
+
+typedef struct
+{
+    char magica[8];
+    int versao;
+    int num_colunas;
+    long long num_linhas;
+    long long tamanho_origem; // Size and modification time of the text file,
+    long long mtime_origem;   // used to detect a stale cache
+    ColunaCache colunas[CACHE_MAX_COLUNAS];
+} CabecalhoCache;
+
+static int criar_diretorio(const char *caminho)
+{
+#ifndef _WIN32
+    return mkdir(caminho, 0755);
+#else
+    return _mkdir(caminho);
+#endif
+}
+
+// Writes the header and columns of a cache file through a temporary name, so an
+// interrupted run never leaves a truncated cache behind
+static int escrever_cache(const char *destino, CabecalhoCache *cab, void *const *dados)
+{
+    char temporario[MAX_FILENAME + 8];
+    snprintf(temporario, sizeof(temporario), "%s.tmp", destino);
+
+    FILE *fp = fopen(temporario, "wb");
+    if (!fp)
+        return -1;
+
+    long long deslocamento = (sizeof(CabecalhoCache) + CACHE_ALINHAMENTO - 1) / CACHE_ALINHAMENTO * CACHE_ALINHAMENTO;
+    for (int c = 0; c < cab->num_colunas; c++)
+    {
+        cab->colunas[c].deslocamento = deslocamento;
+        long long tamanho = cab->num_linhas * cab->colunas[c].bytes_por_valor;
+        deslocamento += (tamanho + CACHE_ALINHAMENTO - 1) / CACHE_ALINHAMENTO * CACHE_ALINHAMENTO;
+    }
+
+    int ok = fwrite(cab, sizeof(CabecalhoCache), 1, fp) == 1;
+    for (int c = 0; c < cab->num_colunas && ok; c++)
+    {
+        ok = fseek64(fp, cab->colunas[c].deslocamento, SEEK_SET) == 0 &&
+             fwrite(dados[c], cab->colunas[c].bytes_por_valor, (size_t)cab->num_linhas, fp) == (size_t)cab->num_linhas;
+    }
+    // Extends the file to the end of the last aligned column
+    ok = ok && fseek64(fp, deslocamento - 1, SEEK_SET) == 0 && fputc(0, fp) != EOF;
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || rename(temporario, destino) != 0)
+    {
+        remove(temporario);
+        return -1;
+    }
+    return 0;
+}
+
+// Index of the score kept in a cache column, or -1
+static int nota_da_coluna(const ColunaCache *col)
+{
+    for (int n = 0; n < NUM_NOTAS; n++)
+        if (col->questao == -1 && strcmp(col->nome, nomes_notas[n]) == 0)
+            return n;
+    return -1;
+}
+
+// Lists the columns of the cache of a file in cab, and in coluna_texto the
+// column of the text file each one comes from. The courses file keeps CO_CURSO
+// and CO_GRUPO (columns 2 and 6, as in extrair_cursos_ads()); the other files
+// keep CO_CURSO and the questions and scores found in their header. For the
+// courses file mapa is filled here.
+static void descrever_colunas(MapaColunas *mapa, int arquivo_cursos, CabecalhoCache *cab, int *coluna_texto)
+{
+    if (arquivo_cursos)
+    {
+        memset(mapa, 0, sizeof(*mapa));
+        mapa->idx_co_curso = 2;
+        mapa->max_coluna = 6;
+    }
+
+    memset(cab, 0, sizeof(*cab));
+    memcpy(cab->magica, CACHE_MAGICA, sizeof(cab->magica));
+    cab->versao = CACHE_VERSAO;
+
+    // Column 0 is always CO_CURSO
+    strcpy(cab->colunas[0].nome, "CO_CURSO");
+    cab->colunas[0].bytes_por_valor = 4;
+    cab->colunas[0].questao = -1;
+    coluna_texto[0] = mapa->idx_co_curso;
+    cab->num_colunas = 1;
+
+    if (arquivo_cursos)
+    {
+        strcpy(cab->colunas[1].nome, "CO_GRUPO");
+        cab->colunas[1].bytes_por_valor = 4;
+        cab->colunas[1].questao = -1;
+        coluna_texto[1] = 6;
+        cab->num_colunas = 2;
+        return;
+    }
+
+    for (int q = 0; q < NUM_QUESTOES; q++)
+    {
+        if (mapa->idx_questao[q] == -1)
+            continue;
+        ColunaCache *col = &cab->colunas[cab->num_colunas];
+        snprintf(col->nome, sizeof(col->nome), "%s", questoes[q].nome);
+        col->bytes_por_valor = 1;
+        col->questao = q;
+        coluna_texto[cab->num_colunas++] = mapa->idx_questao[q];
+    }
+
+    for (int n = 0; n < NUM_NOTAS; n++)
+    {
+        if (mapa->idx_nota[n] == -1)
+            continue;
+        ColunaCache *col = &cab->colunas[cab->num_colunas];
+        snprintf(col->nome, sizeof(col->nome), "%s", nomes_notas[n]);
+        col->bytes_por_valor = 4;
+        col->questao = -1;
+        coluna_texto[cab->num_colunas++] = mapa->idx_nota[n];
+    }
+}
+
+// Parses the rows that start in [p, fim) into the columns listed by
+// descrever_colunas(), appending them from row cab->num_linhas on. The columns
+// grow as needed; *capacidade is their size in rows. The scanner must reach
+// the end of the last row.
+static void ler_colunas_texto(Scanner *scanner, const char *p, const char *fim, const MapaColunas *mapa, int arquivo_cursos,
+                              const int *coluna_texto, CabecalhoCache *cab, void **dados, long long *capacidade)
+{
+    Campo campos[MAX_COLUNAS + 1];
+    int eh_nota[CACHE_MAX_COLUNAS];
+    for (int c = 0; c < cab->num_colunas; c++)
+        eh_nota[c] = nota_da_coluna(&cab->colunas[c]) >= 0;
+
+    while (p < fim)
+    {
+        if (cab->num_linhas == *capacidade)
+        {
+            *capacidade *= 2;
+            for (int c = 0; c < cab->num_colunas; c++)
+                dados[c] = realloc(dados[c], *capacidade * cab->colunas[c].bytes_por_valor);
+        }
+
+        int num_colunas = ler_campos(scanner, p, mapa->max_coluna, campos, &p);
+        long long linha = cab->num_linhas++;
+
+        for (int c = 0; c < cab->num_colunas; c++)
+        {
+            int idx = coluna_texto[c];
+            int completa = arquivo_cursos ? num_colunas >= 6 : num_colunas >= idx && num_colunas >= mapa->idx_co_curso;
+
+            if (eh_nota[c])
+            {
+                int32_t centesimos = CACHE_SEM_VALOR;
+                double valor;
+                if (completa)
+                {
+                    Campo campo = limpar_campo(campos[idx]);
+                    if (campo.tamanho == 0)
+                        centesimos = CACHE_NOTA_VAZIA;
+                    else if (campo_para_decimal(campo, &valor) != 0 || valor * 100.0 >= INT32_MAX || valor * 100.0 <= INT32_MIN + 3)
+                        centesimos = CACHE_NOTA_INVALIDA;
+                    else
+                        centesimos = (int32_t)(valor * 100.0 + (valor >= 0 ? 0.5 : -0.5));
+                }
+                ((int32_t *)dados[c])[linha] = centesimos;
+                continue;
+            }
+
+            if (cab->colunas[c].bytes_por_valor == 4)
+            {
+                ((int32_t *)dados[c])[linha] = num_colunas >= idx && (completa || c == 0)
+                                                   ? campo_para_int(limpar_campo(campos[idx]))
+                                                   : CACHE_SEM_VALOR;
+                continue;
+            }
+
+            unsigned char codigo = CACHE_AUSENTE;
+            if (completa)
+            {
+                Campo resposta = limpar_campo(campos[idx]);
+                if (resposta.tamanho == 0)
+                {
+                    codigo = CACHE_VAZIO;
+                }
+                else
+                {
+                    int categoria = categoria_resposta(&questoes[cab->colunas[c].questao], resposta);
+                    codigo = categoria >= 0 ? (unsigned char)categoria : CACHE_INVALIDO;
+                }
+            }
+            ((unsigned char *)dados[c])[linha] = codigo;
+        }
+    }
+}
+
+// Converts a text file into its columnar cache (see descrever_colunas()).
+// Returns 0 on success, 1 if the file has nothing to cache and -1 on error.
+int gerar_cache(const char *texto, const char *destino, int arquivo_cursos)
+{
+    MapaColunas mapa;
+    if (!arquivo_cursos)
+    {
+        ler_cabecalho(texto, &mapa);
+        if (mapa.tamanho == 0)
+            return 1;
+    }
+
+    ArquivoMapeado arq;
+    if (mapear_arquivo(texto, &arq) != 0)
+        return -1;
+
+    struct stat st;
+    stat(texto, &st);
+
+    CabecalhoCache cab;
+    int coluna_texto[CACHE_MAX_COLUNAS];
+    descrever_colunas(&mapa, arquivo_cursos, &cab, coluna_texto);
+    cab.tamanho_origem = (long long)arq.tamanho;
+    cab.mtime_origem = (long long)st.st_mtime;
+
+    const char *fim = arq.dados + arq.tamanho;
+    Scanner scanner;
+    scanner_iniciar(&scanner, arq.dados, fim);
+    const char *p = scanner_proxima_linha(&scanner); // Skips the header
+
+    long long capacidade = 1 << 16;
+    void *dados[CACHE_MAX_COLUNAS];
+    for (int c = 0; c < cab.num_colunas; c++)
+        dados[c] = malloc(capacidade * cab.colunas[c].bytes_por_valor);
+
+    ler_colunas_texto(&scanner, p, fim, &mapa, arquivo_cursos, coluna_texto, &cab, dados, &capacidade);
+    desmapear_arquivo(&arq);
+
+    int resultado = escrever_cache(destino, &cab, dados);
+    for (int c = 0; c < cab.num_colunas; c++)
+        free(dados[c]);
+    return resultado;
+}
+
+// Reads and validates the header of a cache file. The cache is stale if the
+// text file still exists and its size or modification time changed.
+// Returns 1 if the cache can be used.
+int validar_cache(const char *texto, const char *cache, CabecalhoCache *cab)
+{
+    FILE *fp = fopen(cache, "rb");
+    if (!fp)
+        return 0;
+
+    int ok = fread(cab, sizeof(CabecalhoCache), 1, fp) == 1 &&
+             memcmp(cab->magica, CACHE_MAGICA, sizeof(cab->magica)) == 0 &&
+             cab->versao == CACHE_VERSAO &&
+             cab->num_colunas > 0 && cab->num_colunas <= CACHE_MAX_COLUNAS;
+    fclose(fp);
+
+    struct stat st;
+    if (ok && stat(texto, &st) == 0)
+        ok = (long long)st.st_size == cab->tamanho_origem && (long long)st.st_mtime == cab->mtime_origem;
+
+    return ok;
+}
+
+// Fills the column map of a file counted from its cache. Chunks are measured in
+// bytes of the needed columns, so cached and text files are split alike.
+void ler_cabecalho_cache(const CabecalhoCache *cab, MapaColunas *mapa)
+{
+    memset(mapa, 0, sizeof(*mapa));
+    mapa->em_cache = 1;
+    mapa->idx_co_curso = 0;
+    mapa->bytes_por_linha = 4;
+
+    for (int q = 0; q < NUM_QUESTOES; q++)
+        mapa->idx_questao[q] = -1;
+    for (int n = 0; n < NUM_NOTAS; n++)
+        mapa->idx_nota[n] = -1;
+
+    for (int c = 1; c < cab->num_colunas; c++)
+    {
+        int q = cab->colunas[c].questao;
+        int n = nota_da_coluna(&cab->colunas[c]);
+        if (q >= 0 && q < NUM_QUESTOES)
+        {
+            mapa->idx_questao[q] = c;
+            mapa->bytes_por_linha++;
+        }
+        else if (n >= 0)
+        {
+            mapa->idx_nota[n] = c;
+            mapa->bytes_por_linha += 4;
+        }
+    }
+
+    mapa->num_linhas = cab->num_linhas;
+    if (mapa->bytes_por_linha > 4)
+        mapa->tamanho = cab->num_linhas * mapa->bytes_por_linha;
+}
+
+// Same as contar_respostas() for a cached file: counts the rows whose first
+// byte (in the needed columns) falls inside [inicio, fim). Rows of all caches are
+// aligned, so a cross-tabulation can take its second column from another file:
+// coluna_b[c] points to it (NULL when both columns are in this file).
+long long contar_respostas_cache(const ArquivoMapeado *arq, const MapaColunas *mapa, const unsigned char *const *coluna_b, long long inicio, long long fim, Resultados *resultados)
+{
+    const CabecalhoCache *cab = (const CabecalhoCache *)arq->dados;
+    const int32_t *cursos = (const int32_t *)(arq->dados + cab->colunas[0].deslocamento);
+    const unsigned char *respostas[NUM_QUESTOES];
+    const int32_t *notas[NUM_NOTAS];
+    ContadoresQuestao *contadores = resultados->questoes;
+
+    for (int q = 0; q < NUM_QUESTOES; q++)
+        respostas[q] = mapa->idx_questao[q] == -1 ? NULL : (const unsigned char *)arq->dados + cab->colunas[mapa->idx_questao[q]].deslocamento;
+    for (int n = 0; n < NUM_NOTAS; n++)
+        notas[n] = mapa->idx_nota[n] == -1 ? NULL : (const int32_t *)(arq->dados + cab->colunas[mapa->idx_nota[n]].deslocamento);
+
+    long long primeira = (inicio + mapa->bytes_por_linha - 1) / mapa->bytes_por_linha;
+    long long ultima = (fim + mapa->bytes_por_linha - 1) / mapa->bytes_por_linha;
+    if (ultima > cab->num_linhas)
+        ultima = cab->num_linhas;
+
+    for (long long linha = primeira; linha < ultima; linha++)
+    {
+        int curso_valido = curso_eh_ads(cursos[linha]);
+
+        for (int q = 0; q < NUM_QUESTOES; q++)
+        {
+            if (!respostas[q])
+                continue;
+
+            unsigned char codigo = respostas[q][linha];
+            if (codigo == CACHE_AUSENTE)
+            {
+                contadores[q].ignoradas++;
+                continue;
+            }
+
+            if (!curso_valido)
+                continue;
+
+            if (q == Q_I15)
+                resultados->total_alunos_ads++;
+
+            if (codigo == CACHE_VAZIO)
+                contadores[q].vazio++;
+            else if (codigo < MAX_CATEGORIAS)
+                contadores[q].contadores[codigo]++;
+        }
+
+        for (int n = 0; n < NUM_NOTAS; n++)
+        {
+            if (!notas[n])
+                continue;
+
+            ResumoNota *nota = &resultados->notas[n];
+            int32_t centesimos = notas[n][linha];
+            if (centesimos == CACHE_SEM_VALOR)
+                nota->ignoradas++;
+            else if (!curso_valido)
+                continue;
+            else if (centesimos == CACHE_NOTA_VAZIA)
+                nota->vazio++;
+            else if (centesimos == CACHE_NOTA_INVALIDA)
+                nota->invalidas++;
+            else
+                adicionar_nota(nota, centesimos / 100.0);
+        }
+
+        if (!curso_valido)
+            continue;
+
+        for (unsigned pendentes = mapa->cruzamentos; pendentes; pendentes &= pendentes - 1)
+        {
+            int indice = __builtin_ctz(pendentes);
+            const Cruzamento *c = &cruzamentos[indice];
+            unsigned char a = respostas[c->questao_a][linha];
+            unsigned char b = coluna_b[indice] ? coluna_b[indice][linha] : respostas[c->questao_b][linha];
+            if (a < MAX_CATEGORIAS && b < MAX_CATEGORIAS)
+                resultados->cruzamentos[indice][a][b]++;
+        }
+    }
+    return ultima > primeira ? ultima - primeira : 0;
+}
+
+// Same as extrair_cursos_ads() for a cached courses file, splitting its rows
+// among processes. Returns -1 if the cache cannot be read.
+int extrair_cursos_ads_cache(const char *cache, int rank, int size)
+{
+    ArquivoMapeado arq;
+    if (mapear_arquivo(cache, &arq) != 0)
+        return -1;
+
+    const CabecalhoCache *cab = (const CabecalhoCache *)arq.dados;
+    if (arq.tamanho < sizeof(CabecalhoCache) || cab->num_colunas != 2 || strcmp(cab->colunas[1].nome, "CO_GRUPO") != 0)
+    {
+        desmapear_arquivo(&arq);
+        return -1;
+    }
+
+    const int32_t *cursos = (const int32_t *)(arq.dados + cab->colunas[0].deslocamento);
+    const int32_t *grupos = (const int32_t *)(arq.dados + cab->colunas[1].deslocamento);
+    int linhas_ignoradas_ads = 0;
+    long long primeira = cab->num_linhas * rank / size, ultima = cab->num_linhas * (rank + 1) / size;
+
+    for (long long linha = primeira; linha < ultima; linha++)
+    {
+        if (grupos[linha] == CACHE_SEM_VALOR)
+        {
+            linhas_ignoradas_ads++;
+            continue;
+        }
+
+        if (grupos[linha] == 72 && num_cursos_ads < MAX_COURSES && marcar_curso_ads(cursos[linha]))
+        {
+            cursos_ads[num_cursos_ads++] = cursos[linha];
+        }
+    }
+
+    somar_fase(FASE_CURSOS, 0.0, (ultima - primeira) * 8, ultima - primeira);
+    desmapear_arquivo(&arq);
+    return linhas_ignoradas_ads;
+}
+
+// Hands out chunks to a rank. In static mode the rank walks its own list; in
+// dynamic mode every rank holds the list of all chunks and takes the next free
+// index from a counter on rank 0, updated with MPI_Fetch_and_op, until the list
+// is drained. Faster ranks simply take more chunks.
+typedef struct
+{
+    const Bloco *blocos;
+    int num_blocos;
+    int dinamico;
+    int proximo;       // Static mode: next index in the list
+    int *contador;     // Dynamic mode: window memory (only used on rank 0)
+    MPI_Win janela;
+} Escalonador;
+
+// Collective: every rank must call it with the same mode
+void iniciar_escalonador(Escalonador *esc, const Bloco *blocos, int num_blocos, int dinamico, int rank)
+{
+    esc->blocos = blocos;
+    esc->num_blocos = num_blocos;
+    esc->dinamico = dinamico;
+    esc->proximo = 0;
+    esc->contador = NULL;
+
+    if (dinamico)
+    {
+        MPI_Aint tamanho = rank == 0 ? sizeof(int) : 0;
+        MPI_Win_allocate(tamanho, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &esc->contador, &esc->janela);
+        if (rank == 0)
+            *esc->contador = 0;
+        MPI_Barrier(MPI_COMM_WORLD); // The counter is zeroed before anyone takes a chunk
+        MPI_Win_lock_all(0, esc->janela);
+    }
+}
+
+// Returns the index of the next chunk to count, or -1 when there is none left.
+// Safe to call from several threads of the same rank.
+int proximo_bloco(Escalonador *esc)
+{
+    int indice;
+
+    if (!esc->dinamico)
+    {
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+        indice = esc->proximo++;
+    }
+    else
+    {
+        // Threads of a rank take turns on the window (MPI_THREAD_SERIALIZED)
+#ifdef _OPENMP
+#pragma omp critical(escalonador_mpi)
+#endif
+        {
+            const int um = 1;
+            MPI_Fetch_and_op(&um, &indice, MPI_INT, 0, 0, MPI_SUM, esc->janela);
+            MPI_Win_flush(0, esc->janela);
+        }
+    }
+
+    return indice < esc->num_blocos ? indice : -1;
+}
+
+// Collective
+void finalizar_escalonador(Escalonador *esc)
+{
+    if (esc->dinamico)
+    {
+        MPI_Win_unlock_all(esc->janela);
+        MPI_Win_free(&esc->janela);
+    }
+}
+
+// --- Compressed inputs ---
+// When a text file is missing, it can be read compressed: from its member in
+// the INEP zip given with --zip (stored or DEFLATE), or from a .txt.gz or
+// .txt.zst copy next to it. Built with -DCOM_ZLIB (-lz) for gzip and zip and
+// -DCOM_ZSTD (-lzstd) for zstd. A compressed file is decompressed as a stream
+// into the row scanner and cannot be split, so it is one chunk; different
+// files are decompressed in parallel by the processes and threads.
+
+#define TAMANHO_ENTRADA_COMPRIMIDA (256 << 10)
+
+// A decompressed byte stream over a text or compressed file
+typedef struct
+{
+    Formato formato;
+    FILE *fp;
+    long long restante;        // Zip member: compressed bytes not read yet
+    unsigned char *comprimido; // Input buffer of the decompressor
+    int fim_fluxo;             // The decompressor reached the end of the data
+#ifdef COM_ZLIB
+    gzFile gz;
+    z_stream z;
+#endif
+#ifdef COM_ZSTD
+    ZSTD_DStream *zs;
+    ZSTD_inBuffer in;
+#endif
+    int metodo;
+} Fonte;
+
+static unsigned le16(const unsigned char *p)
+{
+    return p[0] | (unsigned)p[1] << 8;
+}
+
+static unsigned le32(const unsigned char *p)
+{
+    return le16(p) | (unsigned)le16(p + 2) << 16;
+}
+
+static unsigned long long le64(const unsigned char *p)
+{
+    return le32(p) | (unsigned long long)le32(p + 4) << 32;
+}
+
+// Reads the central directory of a zip archive and fills the entries of the
+// members whose base name is nomes[i]. Members not found keep formato = -1.
+// Returns -1 if the archive cannot be read.
+static int ler_diretorio_zip(const char *zip, char nomes[][MAX_FILENAME], int n, Entrada *entradas)
+{
+    FILE *fp = fopen(zip, "rb");
+    if (!fp)
+        return -1;
+
+    // The end of central directory record is in the last 64 KB + 22 bytes
+    unsigned char *fim = malloc(65557);
+    fseek64(fp, 0, SEEK_END);
+    long long tamanho_zip = ftell64(fp);
+    long long inicio_fim = tamanho_zip > 65557 ? tamanho_zip - 65557 : 0;
+    fseek64(fp, inicio_fim, SEEK_SET);
+    long long lidos = (long long)fread(fim, 1, (size_t)(tamanho_zip - inicio_fim), fp);
+
+    long long eocd = -1;
+    for (long long k = lidos - 22; k >= 0 && eocd == -1; k--)
+        if (le32(fim + k) == 0x06054b50)
+            eocd = k;
+    if (eocd == -1)
+    {
+        free(fim);
+        fclose(fp);
+        return -1;
+    }
+
+    long long num_membros = le16(fim + eocd + 10);
+    long long tamanho_dir = le32(fim + eocd + 12);
+    long long inicio_dir = le32(fim + eocd + 16);
+
+    // Zip64: the locator right before the record points to the zip64 record
+    if ((inicio_dir == 0xFFFFFFFFLL || num_membros == 0xFFFF) && eocd >= 20 && le32(fim + eocd - 20) == 0x07064b50)
+    {
+        unsigned char z64[56];
+        fseek64(fp, (long long)le64(fim + eocd - 20 + 8), SEEK_SET);
+        if (fread(z64, 1, sizeof(z64), fp) == sizeof(z64) && le32(z64) == 0x06064b50)
+        {
+            num_membros = (long long)le64(z64 + 32);
+            tamanho_dir = (long long)le64(z64 + 40);
+            inicio_dir = (long long)le64(z64 + 48);
+        }
+    }
+    free(fim);
+
+    unsigned char *dir = malloc(tamanho_dir > 0 ? tamanho_dir : 1);
+    fseek64(fp, inicio_dir, SEEK_SET);
+    if ((long long)fread(dir, 1, (size_t)tamanho_dir, fp) != tamanho_dir)
+    {
+        free(dir);
+        fclose(fp);
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++)
+        entradas[i].formato = -1;
+
+    const unsigned char *p = dir;
+    for (long long m = 0; m < num_membros && p + 46 <= dir + tamanho_dir && le32(p) == 0x02014b50; m++)
+    {
+        unsigned tamanho_nome = le16(p + 28), tamanho_extra = le16(p + 30), tamanho_comentario = le16(p + 32);
+        long long comprimido = le32(p + 20), descomprimido = le32(p + 24), local = le32(p + 42);
+
+        // Zip64 extended information: the 64-bit values of the fields set to 0xFFFFFFFF
+        for (const unsigned char *e = p + 46 + tamanho_nome; e + 4 <= p + 46 + tamanho_nome + tamanho_extra; e += 4 + le16(e + 2))
+        {
+            if (le16(e) != 0x0001)
+                continue;
+            const unsigned char *v = e + 4;
+            if (descomprimido == 0xFFFFFFFFLL)
+                v += 8;
+            if (comprimido == 0xFFFFFFFFLL)
+            {
+                comprimido = (long long)le64(v);
+                v += 8;
+            }
+            if (local == 0xFFFFFFFFLL)
+                local = (long long)le64(v);
+        }
+
+        // Base name of the member
+        const char *nome = (const char *)p + 46;
+        unsigned inicio_base = 0;
+        for (unsigned k = 0; k < tamanho_nome; k++)
+            if (nome[k] == '/' || nome[k] == '\\')
+                inicio_base = k + 1;
+
+        for (int i = 0; i < n; i++)
+        {
+            if (strlen(nomes[i]) != tamanho_nome - inicio_base || memcmp(nomes[i], nome + inicio_base, tamanho_nome - inicio_base) != 0)
+                continue;
+
+            // The data starts after the local header, whose extra field may differ
+            unsigned char local_cab[30];
+            fseek64(fp, local, SEEK_SET);
+            if (fread(local_cab, 1, sizeof(local_cab), fp) != sizeof(local_cab) || le32(local_cab) != 0x04034b50)
+                break;
+            entradas[i].formato = FORMATO_ZIP;
+            entradas[i].metodo = le16(p + 10);
+            entradas[i].crc = le32(p + 16);
+            entradas[i].tamanho = comprimido;
+            entradas[i].deslocamento = local + 30 + le16(local_cab + 26) + le16(local_cab + 28);
+        }
+
+        p += 46 + tamanho_nome + tamanho_extra + tamanho_comentario;
+    }
+
+    free(dir);
+    fclose(fp);
+    return 0;
+}
+
+// Chooses how each input is read: the text file when it exists, otherwise its
+// member in the zip archive (if any), or a .gz or .zst copy. fontes[i] gets the
+// file to open.
+void localizar_entradas(char arquivos[][MAX_FILENAME], int n, const char *zip, char fontes[][MAX_FILENAME], Entrada *entradas)
+{
+    Entrada *membros = NULL;
+    if (zip)
+    {
+        char(*nomes)[MAX_FILENAME] = malloc(n * sizeof(*nomes));
+        for (int i = 0; i < n; i++)
+        {
+            const char *barra = strrchr(arquivos[i], '/');
+            snprintf(nomes[i], MAX_FILENAME, "%s", barra ? barra + 1 : arquivos[i]);
+        }
+        membros = malloc(n * sizeof(Entrada));
+        if (ler_diretorio_zip(zip, nomes, n, membros) != 0)
+        {
+            fprintf(stderr, "Erro ao ler o diretório do arquivo zip %s\n", zip);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        free(nomes);
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        struct stat st;
+        memset(&entradas[i], 0, sizeof(Entrada));
+        snprintf(fontes[i], MAX_FILENAME, "%s", arquivos[i]);
+        if (stat(arquivos[i], &st) == 0)
+            continue;
+
+        if (membros && membros[i].formato == FORMATO_ZIP)
+        {
+            entradas[i] = membros[i];
+            snprintf(fontes[i], MAX_FILENAME, "%s", zip);
+            continue;
+        }
+#ifdef COM_ZLIB
+        snprintf(fontes[i], MAX_FILENAME, "%s.gz", arquivos[i]);
+        if (stat(fontes[i], &st) == 0)
+        {
+            entradas[i].formato = FORMATO_GZIP;
+            entradas[i].tamanho = (long long)st.st_size;
+            continue;
+        }
+#endif
+#ifdef COM_ZSTD
+        snprintf(fontes[i], MAX_FILENAME, "%s.zst", arquivos[i]);
+        if (stat(fontes[i], &st) == 0)
+        {
+            entradas[i].formato = FORMATO_ZSTD;
+            entradas[i].tamanho = (long long)st.st_size;
+            continue;
+        }
+#endif
+        snprintf(fontes[i], MAX_FILENAME, "%s", arquivos[i]);
+    }
+
+    free(membros);
+}
+
+// Opens the stream of a file. Text files start at offset 0; the caller seeks.
+int abrir_fonte(const char *filename, const Entrada *entrada, Fonte *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->formato = entrada->formato;
+
+#ifdef COM_ZLIB
+    if (f->formato == FORMATO_GZIP)
+    {
+        f->gz = gzopen(filename, "rb");
+        if (!f->gz)
+            return -1;
+        gzbuffer(f->gz, TAMANHO_ENTRADA_COMPRIMIDA);
+        return 0;
+    }
+#endif
+
+    f->fp = fopen(filename, "rb");
+    if (!f->fp)
+        return -1;
+    if (f->formato == FORMATO_TEXTO)
+    {
+        setvbuf(f->fp, NULL, _IONBF, 0);
+        return 0;
+    }
+
+    f->comprimido = malloc(TAMANHO_ENTRADA_COMPRIMIDA);
+#ifdef COM_ZLIB
+    if (f->formato == FORMATO_ZIP)
+    {
+        f->metodo = entrada->metodo;
+        f->restante = entrada->tamanho;
+        fseek64(f->fp, entrada->deslocamento, SEEK_SET);
+        if (f->metodo == 0)
+            return 0;
+        if (f->metodo == 8 && inflateInit2(&f->z, -MAX_WBITS) == Z_OK) // Raw DEFLATE
+            return 0;
+        fprintf(stderr, "Erro: método de compressão %d não suportado em %s\n", f->metodo, filename);
+    }
+#endif
+#ifdef COM_ZSTD
+    if (f->formato == FORMATO_ZSTD)
+    {
+        f->zs = ZSTD_createDStream();
+        if (f->zs && !ZSTD_isError(ZSTD_initDStream(f->zs)))
+        {
+            f->in.src = f->comprimido;
+            return 0;
+        }
+    }
+#endif
+
+    free(f->comprimido);
+    fclose(f->fp);
+    return -1;
+}
+
+// Reads up to n decompressed bytes. Returns fewer than n only at the end.
+long long ler_fonte(Fonte *f, char *destino, long long n)
+{
+    if (f->formato == FORMATO_TEXTO || (f->formato == FORMATO_ZIP && f->metodo == 0))
+    {
+        if (f->formato == FORMATO_ZIP && n > f->restante)
+            n = f->restante;
+        long long lidos = (long long)fread(destino, 1, (size_t)n, f->fp);
+        f->restante -= lidos;
+        return lidos;
+    }
+
+    long long total = 0;
+#ifdef COM_ZLIB
+    if (f->formato == FORMATO_GZIP)
+    {
+        while (total < n)
+        {
+            long long pedido = n - total > (1 << 30) ? (1 << 30) : n - total;
+            int lidos = gzread(f->gz, destino + total, (unsigned)pedido);
+            if (lidos <= 0)
+                break;
+            total += lidos;
+        }
+        return total;
+    }
+
+    if (f->formato == FORMATO_ZIP)
+    {
+        while (total < n && !f->fim_fluxo)
+        {
+            if (f->z.avail_in == 0 && f->restante > 0)
+            {
+                long long pedido = f->restante < TAMANHO_ENTRADA_COMPRIMIDA ? f->restante : TAMANHO_ENTRADA_COMPRIMIDA;
+                long long lidos = (long long)fread(f->comprimido, 1, (size_t)pedido, f->fp);
+                if (lidos <= 0)
+                    break;
+                f->restante -= lidos;
+                f->z.next_in = f->comprimido;
+                f->z.avail_in = (unsigned)lidos;
+            }
+
+            long long pedido = n - total > (1 << 30) ? (1 << 30) : n - total;
+            f->z.next_out = (unsigned char *)destino + total;
+            f->z.avail_out = (unsigned)pedido;
+            int r = inflate(&f->z, Z_NO_FLUSH);
+            total += pedido - f->z.avail_out;
+            if (r == Z_STREAM_END)
+                f->fim_fluxo = 1;
+            else if (r != Z_OK && r != Z_BUF_ERROR)
+            {
+                fprintf(stderr, "Erro ao descomprimir um membro do arquivo zip (%d)\n", r);
+                break;
+            }
+            else if (r == Z_BUF_ERROR && f->z.avail_in == 0 && f->restante == 0)
+                break; // Truncated member
+        }
+        return total;
+    }
+#endif
+#ifdef COM_ZSTD
+    if (f->formato == FORMATO_ZSTD)
+    {
+        while (total < n)
+        {
+            if (f->in.pos == f->in.size)
+            {
+                size_t lidos = fread(f->comprimido, 1, TAMANHO_ENTRADA_COMPRIMIDA, f->fp);
+                if (lidos == 0)
+                    break;
+                f->in.size = lidos;
+                f->in.pos = 0;
+            }
+            ZSTD_outBuffer out = {destino + total, (size_t)(n - total), 0};
+            size_t r = ZSTD_decompressStream(f->zs, &out, &f->in);
+            total += (long long)out.pos;
+            if (ZSTD_isError(r))
+            {
+                fprintf(stderr, "Erro ao descomprimir zstd: %s\n", ZSTD_getErrorName(r));
+                break;
+            }
+        }
+        return total;
+    }
+#endif
+    return total;
+}
+
+void fechar_fonte(Fonte *f)
+{
+#ifdef COM_ZLIB
+    if (f->formato == FORMATO_GZIP)
+    {
+        gzclose(f->gz);
+        return;
+    }
+    if (f->formato == FORMATO_ZIP && f->metodo == 8)
+        inflateEnd(&f->z);
+#endif
+#ifdef COM_ZSTD
+    if (f->formato == FORMATO_ZSTD)
+        ZSTD_freeDStream(f->zs);
+#endif
+    free(f->comprimido);
+    fclose(f->fp);
+}
+
+// Reads the header of a compressed file from the start of its stream. The file
+// counts as compressed bytes, and its rows are read from offset 0 on.
+void ler_cabecalho_comprimido(const char *filename, const Entrada *entrada, MapaColunas *mapa)
+{
+    Fonte f;
+    if (abrir_fonte(filename, entrada, &f) != 0)
+    {
+        memset(mapa, 0, sizeof(*mapa));
+        fprintf(stderr, "Erro ao abrir %s\n", filename);
+        return;
+    }
+
+    // Reads until the end of the header row
+    long long capacidade = 1 << 16, n = 0;
+    char *dados = malloc(capacidade);
+    for (;;)
+    {
+        long long lidos = ler_fonte(&f, dados + n, capacidade - n);
+        n += lidos;
+        if (memchr(dados, '\n', (size_t)n) || n < capacidade)
+            break;
+        capacidade *= 2;
+        dados = realloc(dados, capacidade);
+    }
+    fechar_fonte(&f);
+
+    if (interpretar_cabecalho(filename, dados, (size_t)n, mapa))
+    {
+        mapa->entrada = *entrada;
+        mapa->inicio_dados = 0;
+        mapa->tamanho = entrada->tamanho > 0 ? entrada->tamanho : 1;
+    }
+    free(dados);
+}
+
+// --- Read-ahead ---
+// With --leitura-antecipada the chunks of text files are read with plain reads
+// into a queue of buffers instead of being mapped. An I/O thread fills the next
+// buffers while the counting thread parses the current one, so the disk and the
+// CPU work at the same time. Each buffer holds whole rows only: the partial row
+// at the end of a read is moved to the head of the next buffer. Without POSIX
+// threads (Windows) the buffers are filled by the counting thread itself.
+
+#ifndef _WIN32
+#define LEITURA_ASSINCRONA
+#endif
+
+#define LEITURA_FIM_LINHA (64 << 10) // Read size to complete the last row of a chunk
+
+typedef struct
+{
+    long long tamanho_buffer; // Bytes of each buffer
+    int profundidade;         // Buffers in the queue (2 = double buffering)
+} ConfigLeitura;
+
+typedef struct
+{
+    char *dados;
+    long long capacidade;
+    long long base;       // File offset of dados[0]
+    long long inicio;     // Whole rows are in [inicio, fim_linhas)
+    long long fim_linhas;
+    long long lido;       // Bytes read; [fim_linhas, lido) goes to the next buffer
+} BufferLeitura;
+
+typedef struct
+{
+    Fonte fonte;
+    long long fim;   // Rows must start before this offset
+    int pular_cabeca; // The partial row at the head of the chunk is not skipped yet
+    int terminado;   // The last buffer of the chunk was filled
+    int encerrado;   // ... and handed to the parser (set under the lock)
+    long long tamanho_buffer;
+    BufferLeitura *buffers;
+    int profundidade;
+    int produzidos, consumidos;
+    long long bytes; // Read by the I/O side, and the time it took
+    double segundos;
+#ifdef LEITURA_ASSINCRONA
+    pthread_mutex_t trava;
+    pthread_cond_t cheio, vazio;
+#endif
+} Leitor;
+
+// Monotonic clock usable outside MPI threads
+static double relogio(void)
+{
+#ifdef LEITURA_ASSINCRONA
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+    return MPI_Wtime();
+#endif
+}
+
+static void garantir_capacidade(BufferLeitura *buf, long long capacidade)
+{
+    if (buf->capacidade >= capacidade)
+        return;
+    char *dados = realloc(buf->dados, capacidade);
+    if (!dados)
+    {
+        fprintf(stderr, "Erro: memória insuficiente para o buffer de leitura.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    buf->dados = dados;
+    buf->capacidade = capacidade;
+}
+
+// Fills buf with the next whole rows of the chunk, after the partial row left
+// in `anterior`. A row longer than the buffer makes the buffer grow.
+static void preencher_buffer(Leitor *l, BufferLeitura *buf, const BufferLeitura *anterior, long long tamanho_buffer)
+{
+    long long n = 0;
+    if (anterior)
+    {
+        n = anterior->lido - anterior->fim_linhas;
+        garantir_capacidade(buf, n > tamanho_buffer / 2 ? 2 * n : tamanho_buffer);
+        memcpy(buf->dados, anterior->dados + anterior->fim_linhas, (size_t)n);
+        buf->base = anterior->base + anterior->fim_linhas;
+    }
+    buf->inicio = 0;
+
+    for (;;)
+    {
+        if (n == buf->capacidade)
+            garantir_capacidade(buf, 2 * buf->capacidade);
+
+        long long posicao = buf->base + n;
+        long long quer = buf->capacidade - n;
+        if (posicao < l->fim && quer > l->fim - posicao)
+            quer = l->fim - posicao;
+        else if (posicao >= l->fim && quer > LEITURA_FIM_LINHA)
+            quer = LEITURA_FIM_LINHA;
+
+        double t = relogio();
+        long long lidos = ler_fonte(&l->fonte, buf->dados + n, quer);
+        l->segundos += relogio() - t;
+        l->bytes += lidos;
+        n += lidos;
+        posicao += lidos;
+        int acabou = lidos < quer; // End of file
+
+        if (l->pular_cabeca)
+        {
+            const char *nl = memchr(buf->dados + buf->inicio, '\n', (size_t)(n - buf->inicio));
+            if (!nl && !acabou)
+            {
+                // Still inside the row of the previous chunk: drops what was read
+                buf->base += n;
+                n = 0;
+                continue;
+            }
+            buf->inicio = nl ? nl + 1 - buf->dados : n;
+            l->pular_cabeca = 0;
+        }
+
+        long long limite = l->fim - buf->base; // Index of the first byte past the chunk
+        if (buf->inicio >= limite)
+        {
+            // No row starts inside the chunk
+            buf->fim_linhas = buf->lido = buf->inicio;
+            l->terminado = 1;
+            return;
+        }
+
+        if (posicao < l->fim && !acabou)
+        {
+            // Cuts after the last newline; the rest goes to the next buffer
+            long long k = n - 1;
+            while (k >= buf->inicio && buf->dados[k] != '\n')
+                k--;
+            if (k < buf->inicio)
+                continue;
+            buf->fim_linhas = k + 1;
+            buf->lido = n;
+            return;
+        }
+
+        // End of the chunk: completes the row that holds its last byte
+        const char *nl = n >= limite ? memchr(buf->dados + limite - 1, '\n', (size_t)(n - limite + 1)) : NULL;
+        if (nl || acabou)
+        {
+            buf->fim_linhas = buf->lido = nl ? nl + 1 - buf->dados : n;
+            l->terminado = 1;
+            return;
+        }
+    }
+}
+
+#ifdef LEITURA_ASSINCRONA
+// I/O thread: fills the buffers of the queue in order until the chunk ends
+static void *thread_leitura(void *arg)
+{
+    Leitor *l = arg;
+    const BufferLeitura *anterior = NULL;
+
+    while (!l->terminado)
+    {
+        pthread_mutex_lock(&l->trava);
+        while (l->produzidos - l->consumidos == l->profundidade)
+            pthread_cond_wait(&l->vazio, &l->trava);
+        pthread_mutex_unlock(&l->trava);
+
+        BufferLeitura *buf = &l->buffers[l->produzidos % l->profundidade];
+        preencher_buffer(l, buf, anterior, l->tamanho_buffer);
+        anterior = buf;
+
+        pthread_mutex_lock(&l->trava);
+        l->produzidos++;
+        l->encerrado = l->terminado;
+        pthread_cond_signal(&l->cheio);
+        pthread_mutex_unlock(&l->trava);
+    }
+    return NULL;
+}
+#endif
+
+// Counts the rows that start inside [bloco->inicio, bloco->fim) of a text file,
+// or all rows of a compressed file, through the read-ahead queue. `buffers`
+// holds config->profundidade buffers, reused across chunks. Returns the rows
+// counted.
+long long contar_bloco_antecipado(const char *filename, const MapaColunas *mapa, const Bloco *bloco, const ConfigLeitura *config, BufferLeitura *buffers, Resultados *resultados)
+{
+    Leitor l;
+    memset(&l, 0, sizeof(l));
+    if (abrir_fonte(filename, &mapa->entrada, &l.fonte) != 0)
+    {
+        fprintf(stderr, "Erro ao abrir %s\n", filename);
+        return 0;
+    }
+
+    long long inicio = 0;
+    if (mapa->entrada.formato == FORMATO_TEXTO)
+    {
+        // The file must not have shrunk since its header was read
+        if (fseek64(l.fonte.fp, 0, SEEK_END) != 0 || ftell64(l.fonte.fp) < mapa->tamanho)
+        {
+            fprintf(stderr, "Erro: %s mudou de tamanho durante a análise.\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        inicio = bloco->inicio;
+        l.pular_cabeca = inicio > mapa->inicio_dados;
+        if (l.pular_cabeca)
+            inicio--; // The byte before tells whether the chunk starts at a row
+        fseek64(l.fonte.fp, inicio, SEEK_SET);
+        l.fim = bloco->fim;
+    }
+    else
+    {
+        // The whole stream, after its header row
+        l.pular_cabeca = 1;
+        l.fim = LLONG_MAX;
+    }
+    l.buffers = buffers;
+    l.profundidade = config->profundidade;
+    l.tamanho_buffer = config->tamanho_buffer;
+    buffers[0].base = inicio;
+
+    ArquivoMapeado linhas = {NULL, 0, 0};
+    MapaColunas mapa_linhas = *mapa;
+    mapa_linhas.inicio_dados = 0;
+    long long num_linhas = 0;
+
+#ifdef LEITURA_ASSINCRONA
+    pthread_t thread;
+    pthread_mutex_init(&l.trava, NULL);
+    pthread_cond_init(&l.cheio, NULL);
+    pthread_cond_init(&l.vazio, NULL);
+    int assincrona = pthread_create(&thread, NULL, thread_leitura, &l) == 0;
+#else
+    int assincrona = 0;
+#endif
+
+    for (;;)
+    {
+        BufferLeitura *buf = &buffers[l.consumidos % l.profundidade];
+        if (assincrona)
+        {
+#ifdef LEITURA_ASSINCRONA
+            pthread_mutex_lock(&l.trava);
+            while (l.consumidos == l.produzidos && !l.encerrado)
+                pthread_cond_wait(&l.cheio, &l.trava);
+            int vazia = l.consumidos == l.produzidos;
+            pthread_mutex_unlock(&l.trava);
+            if (vazia)
+                break;
+#endif
+        }
+        else
+        {
+            // Synchronous fallback: fills the buffer right before counting it
+            if (l.terminado)
+                break;
+            preencher_buffer(&l, buf, l.consumidos > 0 ? &buffers[(l.consumidos - 1) % l.profundidade] : NULL, l.tamanho_buffer);
+            l.produzidos++;
+        }
+
+        linhas.dados = buf->dados + buf->inicio;
+        linhas.tamanho = (size_t)(buf->fim_linhas - buf->inicio);
+        num_linhas += contar_respostas(&linhas, &mapa_linhas, 0, (long long)linhas.tamanho, resultados);
+
+#ifdef LEITURA_ASSINCRONA
+        pthread_mutex_lock(&l.trava);
+        l.consumidos++;
+        pthread_cond_signal(&l.vazio);
+        pthread_mutex_unlock(&l.trava);
+#else
+        l.consumidos++;
+#endif
+    }
+
+#ifdef LEITURA_ASSINCRONA
+    if (assincrona)
+        pthread_join(thread, NULL);
+    pthread_mutex_destroy(&l.trava);
+    pthread_cond_destroy(&l.cheio);
+    pthread_cond_destroy(&l.vazio);
+#endif
+    fechar_fonte(&l.fonte);
+
+    // I/O time is added per chunk; with read-ahead it overlaps the counting
+    somar_fase(FASE_LEITURA, l.segundos, l.bytes, 0);
+    return num_linhas;
+}
+
+// Same as extrair_cursos_ads() for a compressed courses file, which cannot be
+// split: process 0 streams all its rows.
+int extrair_cursos_ads_comprimido(const char *filename, const Entrada *entrada, int rank)
+{
+    if (rank != 0)
+        return 0;
+
+    Leitor l;
+    memset(&l, 0, sizeof(l));
+    if (abrir_fonte(filename, entrada, &l.fonte) != 0)
+    {
+        fprintf(stderr, "Rank %d: Erro ao abrir %s para extrair cursos ADS.\n", rank, filename);
+        return 0;
+    }
+    l.pular_cabeca = 1;
+    l.fim = LLONG_MAX;
+    l.profundidade = 2;
+    l.tamanho_buffer = 1LL << 20;
+
+    BufferLeitura buffers[2];
+    memset(buffers, 0, sizeof(buffers));
+    for (int i = 0; i < 2; i++)
+        garantir_capacidade(&buffers[i], l.tamanho_buffer);
+
+    int linhas_ignoradas_ads = 0;
+    long long linhas = 0;
+    for (int k = 0; !l.terminado; k++)
+    {
+        BufferLeitura *buf = &buffers[k % 2];
+        preencher_buffer(&l, buf, k > 0 ? &buffers[(k - 1) % 2] : NULL, l.tamanho_buffer);
+
+        Scanner scanner;
+        scanner_iniciar(&scanner, buf->dados + buf->inicio, buf->dados + buf->fim_linhas);
+        linhas_ignoradas_ads += extrair_cursos_linhas(&scanner, buf->dados + buf->inicio, buf->dados + buf->fim_linhas, &linhas);
+    }
+
+    somar_fase(FASE_CURSOS, 0.0, l.bytes, linhas);
+    fechar_fonte(&l.fonte);
+    free(buffers[0].dados);
+    free(buffers[1].dados);
+    return linhas_ignoradas_ads;
+}
+
+// Counts the chunks handed out by the scheduler, keeping a file mapped while
+// consecutive chunks come from it. arquivos[i] is the cache of file i when
+// mapas[i].em_cache is set. The counts of file i go to por_arquivo[i]. With
+// `leitura`, chunks of text files go through the read-ahead queue instead, as
+// compressed files always do.
+void processar_blocos(char arquivos[][MAX_FILENAME], const MapaColunas *mapas, Escalonador *esc, const ConfigLeitura *leitura, Resultados *por_arquivo)
+{
+    ArquivoMapeado arq = {0};
+    ArquivoMapeado parceiros[MAX_CRUZAMENTOS] = {{0}}; // Caches holding the second column of a cross-tab
+    const unsigned char *coluna_b[MAX_CRUZAMENTOS] = {NULL};
+    int arquivo_aberto = -1;
+    int b;
+    long long bytes = 0, linhas = 0;
+
+    const ConfigLeitura padrao = {1LL << 20, 2};
+    const ConfigLeitura *config = leitura ? leitura : &padrao;
+    BufferLeitura *buffers = NULL;
+
+    while ((b = proximo_bloco(esc)) != -1)
+    {
+        const Bloco *bloco = &esc->blocos[b];
+        const MapaColunas *mapa = &mapas[bloco->arquivo];
+        if ((leitura && !mapa->em_cache) || mapa->entrada.formato != FORMATO_TEXTO)
+        {
+            if (!buffers)
+            {
+                buffers = calloc(config->profundidade, sizeof(BufferLeitura));
+                for (int i = 0; i < config->profundidade; i++)
+                    garantir_capacidade(&buffers[i], config->tamanho_buffer);
+            }
+            linhas += contar_bloco_antecipado(arquivos[bloco->arquivo], mapa, bloco, config, buffers, &por_arquivo[bloco->arquivo]);
+            bytes += bloco->fim - bloco->inicio;
+            continue;
+        }
+
+        if (bloco->arquivo != arquivo_aberto)
+        {
+            if (arquivo_aberto != -1)
+            {
+                desmapear_arquivo(&arq);
+                for (int c = 0; c < num_cruzamentos; c++)
+                {
+                    if (coluna_b[c])
+                        desmapear_arquivo(&parceiros[c]);
+                    coluna_b[c] = NULL;
+                }
+            }
+            arquivo_aberto = -1;
+
+            if (mapear_arquivo(arquivos[bloco->arquivo], &arq) != 0)
+            {
+                fprintf(stderr, "Erro ao abrir %s\n", arquivos[bloco->arquivo]);
+                continue;
+            }
+            arquivo_aberto = bloco->arquivo;
+
+            // The file must not have shrunk since its header was read
+            if (!mapa->em_cache && (long long)arq.tamanho < mapa->tamanho)
+            {
+                fprintf(stderr, "Erro: %s mudou de tamanho durante a análise.\n", arquivos[bloco->arquivo]);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
+            // Maps the caches of cross-tab columns that live in other files
+            for (int c = 0; c < num_cruzamentos; c++)
+            {
+                int outro = cruzamentos[c].arquivo_b;
+                if (!(mapa->cruzamentos & (1u << c)) || cruzamentos[c].arquivo_a == outro)
+                    continue;
+
+                if (mapear_arquivo(arquivos[outro], &parceiros[c]) != 0)
+                {
+                    fprintf(stderr, "Erro ao abrir %s\n", arquivos[outro]);
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+                const CabecalhoCache *cab = (const CabecalhoCache *)parceiros[c].dados;
+                coluna_b[c] = (const unsigned char *)parceiros[c].dados + cab->colunas[mapas[outro].idx_questao[cruzamentos[c].questao_b]].deslocamento;
+            }
+        }
+
+        if (mapa->em_cache)
+            linhas += contar_respostas_cache(&arq, mapa, coluna_b, bloco->inicio, bloco->fim, &por_arquivo[bloco->arquivo]);
+        else
+            linhas += contar_respostas(&arq, mapa, bloco->inicio, bloco->fim, &por_arquivo[bloco->arquivo]);
+        bytes += bloco->fim - bloco->inicio;
+    }
+
+    if (arquivo_aberto != -1)
+    {
+        desmapear_arquivo(&arq);
+        for (int c = 0; c < num_cruzamentos; c++)
+            if (coluna_b[c])
+                desmapear_arquivo(&parceiros[c]);
+    }
+
+    if (buffers)
+    {
+        for (int i = 0; i < config->profundidade; i++)
+            free(buffers[i].dados);
+        free(buffers);
+    }
+
+    somar_fase(FASE_CONTAGEM, 0.0, bytes, linhas);
+}
+
+// --- MPI-IO input backend ---
+// With --mpi-io the text files are read with collective MPI-IO instead of
+// being mapped by each process on its own. For every file, each process reads
+// its share of the bytes (the same shares of dividir_blocos(), with boundaries
+// aligned to ALINHAMENTO_MPI_IO) in one MPI_File_read_at_all, so the MPI library
+// can aggregate the requests. A share rarely starts at a row boundary: the
+// partial row at its head is sent to the previous process that has bytes of
+// the file, which appends it to the end of its own share.
+
+#define ALINHAMENTO_MPI_IO (1LL << 20)
+#define MAX_LEITURA_MPI_IO (1LL << 30) // Largest count of one MPI-IO call
+#define TAG_TAMANHO_FRAGMENTO 1
+#define TAG_FRAGMENTO 2
+
+// Byte range [*ini, *fim) of file `arquivo` that falls in the share of a rank.
+// Boundaries inside the file are rounded to ALINHAMENTO_MPI_IO; both neighbors
+// round a shared boundary the same way, so the ranges still cover the file.
+static void faixa_no_arquivo(const MapaColunas *mapas, int num_arquivos, int arquivo, int rank, int size, long long *ini, long long *fim)
+{
+    long long total = 0, deslocamento = 0;
+    for (int i = 0; i < num_arquivos; i++)
+    {
+        if (mapas[i].tamanho <= 0)
+            continue;
+        if (i < arquivo)
+            deslocamento += mapas[i].tamanho - mapas[i].inicio_dados;
+        total += mapas[i].tamanho - mapas[i].inicio_dados;
+    }
+
+    const MapaColunas *mapa = &mapas[arquivo];
+    long long limites[2] = {total * rank / size, total * (rank + 1) / size};
+
+    for (int k = 0; k < 2; k++)
+    {
+        long long b = limites[k] - deslocamento + mapa->inicio_dados; // In file offsets
+        if (b <= mapa->inicio_dados)
+            b = mapa->inicio_dados;
+        else if (b >= mapa->tamanho)
+            b = mapa->tamanho;
+        else
+        {
+            b = (b + ALINHAMENTO_MPI_IO / 2) / ALINHAMENTO_MPI_IO * ALINHAMENTO_MPI_IO;
+            if (b < mapa->inicio_dados)
+                b = mapa->inicio_dados;
+            if (b > mapa->tamanho)
+                b = mapa->tamanho;
+        }
+        limites[k] = b;
+    }
+
+    *ini = limites[0];
+    *fim = limites[1];
+}
+
+// Collective read of [inicio, inicio + tamanho) into buffer. Every process makes
+// the same number of MPI_File_read_at_all calls, even with nothing to read.
+static void ler_faixa_coletiva(MPI_File fh, long long inicio, long long tamanho, char *buffer)
+{
+    long long voltas = (tamanho + MAX_LEITURA_MPI_IO - 1) / MAX_LEITURA_MPI_IO, max_voltas;
+    MPI_Allreduce(&voltas, &max_voltas, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+
+    for (long long v = 0; v < max_voltas; v++)
+    {
+        long long lido = v * MAX_LEITURA_MPI_IO;
+        long long n = tamanho - lido;
+        if (n < 0)
+            n = 0;
+        if (n > MAX_LEITURA_MPI_IO)
+            n = MAX_LEITURA_MPI_IO;
+        MPI_File_read_at_all(fh, (MPI_Offset)(inicio + lido), buffer + (n > 0 ? lido : 0), (int)n, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+}
+
+// Collective: reads and counts every text file with MPI-IO (cached and
+// compressed files are left to processar_blocos()). The counts of file i go to
+// por_arquivo[i].
+void processar_mpi_io(char arquivos[][MAX_FILENAME], const MapaColunas *mapas, int num_arquivos, int rank, int size, int num_threads, Resultados *por_arquivo)
+{
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "romio_cb_read", "enable");
+    MPI_Info_set(info, "cb_buffer_size", "16777216");
+
+    for (int i = 0; i < num_arquivos; i++)
+    {
+        const MapaColunas *mapa = &mapas[i];
+        if (mapa->tamanho <= 0 || mapa->em_cache || mapa->entrada.formato != FORMATO_TEXTO)
+            continue;
+
+        MPI_File fh;
+        if (MPI_File_open(MPI_COMM_WORLD, arquivos[i], MPI_MODE_RDONLY, info, &fh) != MPI_SUCCESS)
+        {
+            if (rank == 0)
+                fprintf(stderr, "Erro ao abrir %s com MPI-IO\n", arquivos[i]);
+            continue;
+        }
+
+        // Neighbors: the closest processes, before and after, with bytes of this file
+        long long ini, fim;
+        int anterior = MPI_PROC_NULL, proximo = MPI_PROC_NULL;
+        faixa_no_arquivo(mapas, num_arquivos, i, rank, size, &ini, &fim);
+        if (fim > ini)
+        {
+            for (int r = rank - 1; r >= 0 && anterior == MPI_PROC_NULL; r--)
+            {
+                long long a, b;
+                faixa_no_arquivo(mapas, num_arquivos, i, r, size, &a, &b);
+                if (b > a)
+                    anterior = r;
+            }
+            for (int r = rank + 1; r < size && proximo == MPI_PROC_NULL; r++)
+            {
+                long long a, b;
+                faixa_no_arquivo(mapas, num_arquivos, i, r, size, &a, &b);
+                if (b > a)
+                    proximo = r;
+            }
+        }
+
+        // The byte before the share tells whether it starts at a row boundary
+        long long antes = fim > ini && ini > mapa->inicio_dados ? 1 : 0;
+        long long tamanho = fim > ini ? fim - ini + antes : 0;
+        double inicio_leitura = MPI_Wtime();
+        char *buffer = malloc(tamanho > 0 ? tamanho : 1);
+        ler_faixa_coletiva(fh, ini - antes, tamanho, buffer);
+        MPI_File_close(&fh);
+
+        // Head of the share that belongs to the last row of the previous process
+        long long cabeca = 0;
+        if (antes && buffer[0] != '\n')
+        {
+            const char *nl = memchr(buffer + 1, '\n', (size_t)(tamanho - 1));
+            if (!nl)
+            {
+                fprintf(stderr, "Erro: a faixa de %s do processo %d não contém uma linha inteira; use menos processos.\n", arquivos[i], rank);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            cabeca = (long long)(nl - (buffer + 1)) + 1;
+        }
+
+        long long cauda = 0;
+        MPI_Sendrecv(&cabeca, 1, MPI_LONG_LONG, anterior, TAG_TAMANHO_FRAGMENTO,
+                     &cauda, 1, MPI_LONG_LONG, proximo, TAG_TAMANHO_FRAGMENTO, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        buffer = realloc(buffer, tamanho + cauda > 0 ? tamanho + cauda : 1);
+        MPI_Sendrecv(buffer + antes, (int)cabeca, MPI_BYTE, anterior, TAG_FRAGMENTO,
+                     buffer + tamanho, (int)cauda, MPI_BYTE, proximo, TAG_FRAGMENTO, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        // Whole rows of this process: the share without its head, plus the tail
+        // received from the next process. They are counted like a mapped file.
+        ArquivoMapeado linhas = {buffer + antes + cabeca, fim > ini ? (size_t)(tamanho - antes - cabeca + cauda) : 0, 0};
+        MapaColunas mapa_linhas = *mapa;
+        mapa_linhas.inicio_dados = 0;
+        somar_fase(FASE_LEITURA, MPI_Wtime() - inicio_leitura, tamanho + cauda, 0);
+
+        double inicio_contagem = MPI_Wtime();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif
+        {
+            Resultados resultados_thread = {0};
+            int t = 0, num_t = 1;
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+            num_t = omp_get_num_threads();
+#else
+            (void)num_threads;
+#endif
+            long long n = (long long)linhas.tamanho;
+            long long num_linhas = contar_respostas(&linhas, &mapa_linhas, n * t / num_t, n * (t + 1) / num_t, &resultados_thread);
+            somar_fase(FASE_CONTAGEM, 0.0, n * (t + 1) / num_t - n * t / num_t, num_linhas);
+
+#ifdef _OPENMP
+#pragma omp critical(somar_resultados)
+#endif
+            somar_resultados(&por_arquivo[i], &resultados_thread);
+        }
+
+        somar_fase(FASE_CONTAGEM, MPI_Wtime() - inicio_contagem, 0, 0);
+        free(buffer);
+    }
+
+    MPI_Info_free(&info);
+}
+
+// --- Incremental results store ---
+// With --incremental the counters of each file are saved in 2.DADOS/resultados
+// together with the size, modification time and content hash of the file. A
+// later run reuses the stored counters of every file that did not change and
+// only reads the new or replaced ones.
+
+#define RESULTADOS_MAGICA "ENADERS"
+#define RESULTADOS_VERSAO 2
+#define FNV_INICIAL 14695981039346656037ULL
+
+typedef struct
+{
+    char magica[8];
+    int versao;
+    int reservado;
+    long long tamanho;             // Size and modification time of the file
+    long long mtime;               // when it was counted
+    unsigned long long hash;       // FNV-1a of its contents
+    unsigned long long assinatura; // What else the counters depend on
+    Resultados resultados;
+} ResultadoArquivo;
+
+static unsigned long long fnv1a(unsigned long long hash, const void *dados, size_t tamanho)
+{
+    const unsigned char *p = dados;
+    for (size_t i = 0; i < tamanho; i++)
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// Content hash of a file; 0 if it cannot be read
+static unsigned long long hash_arquivo(const char *filename)
+{
+    ArquivoMapeado arq;
+    if (mapear_arquivo(filename, &arq) != 0)
+        return 0;
+    unsigned long long hash = fnv1a(FNV_INICIAL, arq.dados, arq.tamanho);
+    desmapear_arquivo(&arq);
+    return hash;
+}
+
+// Collective: content hashes of the files named in origens (empty name: none),
+// taken by all processes at once instead of one after another on process 0.
+// Largest files first, each file goes to the process with the fewest bytes so
+// far; the hashes are gathered on process 0. origens and tamanhos are only
+// needed on process 0.
+void hashear_arquivos(char origens[][MAX_FILENAME], long long *tamanhos, int n, int rank, int size, unsigned long long *hashes)
+{
+    MPI_Bcast(origens, n * MAX_FILENAME, MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(tamanhos, n, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    long long *carga = calloc(size, sizeof(long long));
+    unsigned long long *locais = calloc(n, sizeof(unsigned long long));
+    int *atribuido = calloc(n, sizeof(int));
+    long long bytes = 0;
+
+    for (;;)
+    {
+        int maior = -1;
+        for (int i = 0; i < n; i++)
+            if (origens[i][0] && !atribuido[i] && (maior == -1 || tamanhos[i] > tamanhos[maior]))
+                maior = i;
+        if (maior == -1)
+            break;
+        atribuido[maior] = 1;
+
+        int destino = 0;
+        for (int r = 1; r < size; r++)
+            if (carga[r] < carga[destino])
+                destino = r;
+        carga[destino] += tamanhos[maior];
+        if (destino == rank)
+        {
+            locais[maior] = hash_arquivo(origens[maior]);
+            bytes += tamanhos[maior];
+        }
+    }
+
+    // Every hash comes from one process and the others contribute 0
+    MPI_Reduce(locais, hashes, n, MPI_UNSIGNED_LONG_LONG, MPI_BXOR, 0, MPI_COMM_WORLD);
+    somar_fase(FASE_CABECALHOS, 0.0, bytes, 0);
+    free(carga);
+    free(locais);
+    free(atribuido);
+}
+
+// File that identifies an input: the text file, its cache when only the cache
+// is present, or the compressed copy it is read from. Fills its size and
+// modification time; -1 if none exists. A zip member has no file of its own:
+// *origem is NULL and its compressed size and CRC stand for size and time.
+static int origem_resultado(const char *texto, const char *cache, const char *fonte, const Entrada *entrada,
+                            const char **origem, long long *tamanho, long long *mtime)
+{
+    struct stat st;
+    if (stat(texto, &st) == 0)
+        *origem = texto;
+    else if (stat(cache, &st) == 0)
+        *origem = cache;
+    else if (entrada->formato == FORMATO_ZIP)
+    {
+        *origem = NULL;
+        *tamanho = entrada->tamanho;
+        *mtime = (long long)entrada->crc;
+        return 0;
+    }
+    else if (entrada->formato != FORMATO_TEXTO && stat(fonte, &st) == 0)
+        *origem = fonte;
+    else
+        return -1;
+
+    *tamanho = (long long)st.st_size;
+    *mtime = (long long)st.st_mtime;
+    return 0;
+}
+
+// Signature of the inputs besides the file itself that its counters depend on:
+// the ADS courses, the requested cross-tabs and the files holding the second
+// column of the cross-tabs this file drives. metadados[i] is {size, mtime}.
+unsigned long long assinatura_resultados(const MapaColunas *mapas, int arquivo, const long long (*metadados)[2])
+{
+    int versao = RESULTADOS_VERSAO;
+    unsigned long long hash = fnv1a(FNV_INICIAL, &versao, sizeof(versao));
+    hash = fnv1a(hash, &num_cursos_ads, sizeof(num_cursos_ads));
+    hash = fnv1a(hash, cursos_ads, num_cursos_ads * sizeof(int));
+    hash = fnv1a(hash, &num_cruzamentos, sizeof(num_cruzamentos));
+    hash = fnv1a(hash, cruzamentos, num_cruzamentos * sizeof(Cruzamento));
+
+    for (int c = 0; c < num_cruzamentos; c++)
+    {
+        int outro = cruzamentos[c].arquivo_b;
+        if ((mapas[arquivo].cruzamentos & (1u << c)) && outro != arquivo)
+            hash = fnv1a(hash, metadados[outro], sizeof(metadados[outro]));
+    }
+    return hash;
+}
+
+// Writes the stored counters of a file through a temporary name
+int salvar_resultado(const char *destino, const ResultadoArquivo *r)
+{
+    char temporario[MAX_FILENAME + 8];
+    snprintf(temporario, sizeof(temporario), "%s.tmp", destino);
+
+    FILE *fp = fopen(temporario, "wb");
+    if (!fp)
+        return -1;
+    int ok = fwrite(r, sizeof(*r), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || rename(temporario, destino) != 0)
+    {
+        remove(temporario);
+        return -1;
+    }
+    return 0;
+}
+
+// Loads the stored counters of a file if they are still valid: same size and
+// signature, and the same modification time or, when only the time changed,
+// the same contents (the new time is then saved to skip the hash next run).
+// Without an `origem` file (a zip member) the time is compared only.
+// Returns 1 if the counters can be reused.
+int carregar_resultado(const char *salvo, const char *origem, long long tamanho, long long mtime, unsigned long long assinatura, ResultadoArquivo *r)
+{
+    FILE *fp = fopen(salvo, "rb");
+    if (!fp)
+        return 0;
+
+    int ok = fread(r, sizeof(*r), 1, fp) == 1 &&
+             memcmp(r->magica, RESULTADOS_MAGICA, sizeof(r->magica)) == 0 &&
+             r->versao == RESULTADOS_VERSAO &&
+             r->tamanho == tamanho && r->assinatura == assinatura;
+    fclose(fp);
+
+    if (ok && r->mtime != mtime)
+    {
+        ok = origem && hash_arquivo(origem) == r->hash;
+        if (ok)
+        {
+            r->mtime = mtime;
+            salvar_resultado(salvo, r);
+        }
+    }
+    return ok;
+}
+
+// Marks the files that drive each cross-tabulation: every file holding both
+// columns counts its rows. If no file holds both, the columns of two different
+// files can only be joined row by row through the cache, whose rows are aligned
+// across files; then the file of A drives it and reads B from the other cache.
+void localizar_cruzamentos(MapaColunas *mapas, int num_arquivos)
+{
+    for (int c = 0; c < num_cruzamentos; c++)
+    {
+        Cruzamento *cruz = &cruzamentos[c];
+        const char *nome_a = questoes[cruz->questao_a].nome, *nome_b = questoes[cruz->questao_b].nome;
+        int juntos = 0;
+
+        cruz->arquivo_a = cruz->arquivo_b = -1;
+        for (int i = 0; i < num_arquivos; i++)
+        {
+            if (mapas[i].tamanho <= 0)
+                continue;
+
+            int tem_a = mapas[i].idx_questao[cruz->questao_a] != -1;
+            int tem_b = mapas[i].idx_questao[cruz->questao_b] != -1;
+            if (tem_a && tem_b)
+            {
+                mapas[i].cruzamentos |= 1u << c;
+                cruz->arquivo_a = cruz->arquivo_b = i;
+                juntos = 1;
+            }
+            else if (!juntos)
+            {
+                if (tem_a && cruz->arquivo_a == -1)
+                    cruz->arquivo_a = i;
+                if (tem_b && cruz->arquivo_b == -1)
+                    cruz->arquivo_b = i;
+            }
+        }
+
+        if (juntos)
+            continue;
+
+        if (cruz->arquivo_a == -1 || cruz->arquivo_b == -1)
+        {
+            fprintf(stderr, "Aviso: cruzamento %s x %s ignorado: coluna não encontrada.\n", nome_a, nome_b);
+            cruz->arquivo_a = cruz->arquivo_b = -1;
+            continue;
+        }
+
+        const MapaColunas *a = &mapas[cruz->arquivo_a], *b = &mapas[cruz->arquivo_b];
+        if (!a->em_cache || !b->em_cache || a->num_linhas != b->num_linhas)
+        {
+            fprintf(stderr, "Aviso: cruzamento %s x %s ignorado: as colunas estão em arquivos diferentes e só podem ser cruzadas pelo cache (--cache).\n", nome_a, nome_b);
+            cruz->arquivo_a = cruz->arquivo_b = -1;
+            continue;
+        }
+
+        mapas[cruz->arquivo_a].cruzamentos |= 1u << c;
+    }
+}
+
+// Writes the label of a category of a question into rotulo
+static void rotulo_categoria(const Questao *q, int categoria, char *rotulo, size_t tamanho)
+{
+    static const char *sexo[] = {"M", "F"};
+    static const char *pr_ger[] = {"222", "333", "444", "555", "556"};
+
+    switch (q->tipo)
+    {
+    case TIPO_SEXO:
+        snprintf(rotulo, tamanho, "%s", sexo[categoria]);
+        break;
+    case TIPO_PR_GER:
+        snprintf(rotulo, tamanho, "%s", pr_ger[categoria]);
+        break;
+    case TIPO_LETRA:
+        snprintf(rotulo, tamanho, "%c", 'A' + categoria);
+        break;
+    }
+}
+
+// Prints the matrix of a cross-tabulation (rows: categories of A)
+void imprimir_cruzamento(int indice, const Resultados *resultados)
+{
+    const Cruzamento *c = &cruzamentos[indice];
+    const Questao *a = &questoes[c->questao_a], *b = &questoes[c->questao_b];
+    char rotulo[8];
+
+    printf("\nCruzamento %s x %s (linhas: %s, colunas: %s):\n", a->nome, b->nome, a->nome, b->nome);
+    if (c->arquivo_a == -1)
+    {
+        printf("   Não calculado (veja os avisos acima).\n");
+        return;
+    }
+
+    printf("   %6s", "");
+    for (int j = 0; j < b->num_categorias; j++)
+    {
+        rotulo_categoria(b, j, rotulo, sizeof(rotulo));
+        printf(" %8s", rotulo);
+    }
+    printf("\n");
+
+    for (int i = 0; i < a->num_categorias; i++)
+    {
+        rotulo_categoria(a, i, rotulo, sizeof(rotulo));
+        printf("   %6s", rotulo);
+        for (int j = 0; j < b->num_categorias; j++)
+            printf(" %8lld", resultados->cruzamentos[indice][i][j]);
+        printf("\n");
+    }
+}
+
+// Square root by Newton's method, so the program does not need libm
+static double raiz_quadrada(double x)
+{
+    if (x <= 0.0)
+        return 0.0;
+    double r = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 100; i++)
+    {
+        double proxima = 0.5 * (r + x / r);
+        if (proxima >= r)
+            break;
+        r = proxima;
+    }
+    return r;
+}
+
+// Prints the summary of a score: counts, mean, standard deviation, range,
+// approximate quantiles and the histogram
+void imprimir_nota(int indice, const ResumoNota *nota)
+{
+    static const char *descricoes[NUM_NOTAS] = {"Nota bruta da prova", "Nota bruta na formação geral"};
+    static const double quantis[] = {0.10, 0.25, 0.50, 0.75, 0.90};
+    static const char *nomes_quantis[] = {"P10", "P25", "Mediana", "P75", "P90"};
+
+    printf("\n%s - %s:\n", nomes_notas[indice], descricoes[indice]);
+    printf("   Notas válidas: %lld\n", nota->n);
+    printf("   Notas vazias (%s): %lld\n", nomes_notas[indice], nota->vazio);
+    printf("   Notas inválidas (%s): %lld\n", nomes_notas[indice], nota->invalidas);
+    printf("   Linhas ignoradas por incompletude (%s): %lld\n", nomes_notas[indice], nota->ignoradas);
+    if (nota->n == 0)
+    {
+        printf("   Nenhuma nota válida.\n");
+        return;
+    }
+
+    double variancia = nota->n > 1 ? nota->m2 / (nota->n - 1) : 0.0;
+    printf("   Média: %.2f\n", nota->media);
+    printf("   Desvio padrão: %.2f\n", raiz_quadrada(variancia));
+    printf("   Mínimo: %.2f\n", nota->min);
+    printf("   Máximo: %.2f\n", nota->max);
+    for (int i = 0; i < (int)(sizeof(quantis) / sizeof(quantis[0])); i++)
+        printf("   %s (aprox.): %.2f\n", nomes_quantis[i], quantil_sketch(&nota->quantis, quantis[i]));
+
+    printf("   Distribuição:\n");
+    double largura = NOTA_MAXIMA / NUM_FAIXAS_NOTA;
+    for (int f = 0; f < NUM_FAIXAS_NOTA; f++)
+        printf("   [%5.1f, %5.1f%c: %lld\n", f * largura, (f + 1) * largura, f == NUM_FAIXAS_NOTA - 1 ? ']' : ')', nota->faixas[f]);
+}
+
+typedef struct
+{
+    double min, max, media, desequilibrio; // desequilibrio = max / media
+} Estatistica;
+
+static Estatistica estatistica(const double *valores, int n)
+{
+    Estatistica e = {valores[0], valores[0], 0.0, 1.0};
+    for (int i = 0; i < n; i++)
+    {
+        if (valores[i] < e.min)
+            e.min = valores[i];
+        if (valores[i] > e.max)
+            e.max = valores[i];
+        e.media += valores[i] / n;
+    }
+    if (e.media > 0.0)
+        e.desequilibrio = e.max / e.media;
+    return e;
+}
+
+// Writes the metrics of all processes (todas[rank]) as JSON, or as CSV when the
+// name ends in .csv. Per phase, seconds, bytes and rows get min/max/mean and the
+// imbalance ratio across processes. Returns -1 if the file cannot be written.
+int escrever_metricas(const char *destino, const Metricas *todas, int size, int num_threads)
+{
+    FILE *fp = fopen(destino, "w");
+    if (!fp)
+        return -1;
+
+    size_t tamanho_nome = strlen(destino);
+    int csv = tamanho_nome >= 4 && strcmp(destino + tamanho_nome - 4, ".csv") == 0;
+    static const char *grandezas[3] = {"segundos", "bytes", "linhas"};
+    double *valores = malloc(size * sizeof(double));
+
+    if (csv)
+        fprintf(fp, "fase,processo,segundos,bytes,linhas\n");
+    else
+        fprintf(fp, "{\n  \"processos\": %d,\n  \"threads\": %d,\n  \"fases\": [\n", size, num_threads);
+
+    for (int f = 0; f < NUM_FASES; f++)
+    {
+        Estatistica est[3];
+        for (int g = 0; g < 3; g++)
+        {
+            for (int r = 0; r < size; r++)
+                valores[r] = g == 0 ? todas[r].segundos[f] : g == 1 ? (double)todas[r].bytes[f] : (double)todas[r].linhas[f];
+            est[g] = estatistica(valores, size);
+        }
+
+        if (csv)
+        {
+            for (int r = 0; r < size; r++)
+                fprintf(fp, "%s,%d,%.6f,%lld,%lld\n", nomes_fases[f], r, todas[r].segundos[f], todas[r].bytes[f], todas[r].linhas[f]);
+            fprintf(fp, "%s,min,%.6f,%.0f,%.0f\n", nomes_fases[f], est[0].min, est[1].min, est[2].min);
+            fprintf(fp, "%s,max,%.6f,%.0f,%.0f\n", nomes_fases[f], est[0].max, est[1].max, est[2].max);
+            fprintf(fp, "%s,media,%.6f,%.1f,%.1f\n", nomes_fases[f], est[0].media, est[1].media, est[2].media);
+            fprintf(fp, "%s,desequilibrio,%.4f,%.4f,%.4f\n", nomes_fases[f], est[0].desequilibrio, est[1].desequilibrio, est[2].desequilibrio);
+            continue;
+        }
+
+        fprintf(fp, "    {\n      \"fase\": \"%s\",\n", nomes_fases[f]);
+        for (int g = 0; g < 3; g++)
+        {
+            int casas = g == 0 ? 6 : 0; // Seconds or whole counts
+            fprintf(fp, "      \"%s\": {\"min\": %.*f, \"max\": %.*f, \"media\": %.*f, \"desequilibrio\": %.4f, \"por_processo\": [",
+                    grandezas[g], casas, est[g].min, casas, est[g].max, g == 0 ? 6 : 1, est[g].media, est[g].desequilibrio);
+            for (int r = 0; r < size; r++)
+            {
+                if (g == 0)
+                    fprintf(fp, "%s%.6f", r ? ", " : "", todas[r].segundos[f]);
+                else
+                    fprintf(fp, "%s%lld", r ? ", " : "", g == 1 ? todas[r].bytes[f] : todas[r].linhas[f]);
+            }
+            fprintf(fp, "]}%s\n", g < 2 ? "," : "");
+        }
+        fprintf(fp, "    }%s\n", f < NUM_FASES - 1 ? "," : "");
+    }
+
+    if (!csv)
+        fprintf(fp, "  ]\n}\n");
+
+    free(valores);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+// Command line options
+typedef struct
+{
+    long long tamanho_bloco; // Maximum size of a work chunk, in bytes
+    int dinamico;            // Chunks are taken on demand instead of split up front
+    int num_threads;         // Threads counting chunks inside each rank
+    int usar_cache;          // Counts from the columnar cache when it is valid
+    int gerar_cache;         // Converts the text files into the cache first
+    int mpi_io;              // Reads the text files with collective MPI-IO
+    int incremental;         // Reuses the stored counters of unchanged files
+    const char *metricas;    // File for the per-process phase metrics, or NULL
+    int leitura_antecipada;  // Reads text chunks through the read-ahead queue
+    ConfigLeitura leitura;
+    const char *zip;         // Zip archive holding the inputs missing as text, or NULL
+    const char *servidor;    // Socket of the query server, or NULL for the report
+} Opcoes;
+
+// Finds a question of the table by its column name; -1 if it is not analyzed
+static int buscar_questao(const char *nome, size_t tamanho)
+{
+    for (int q = 0; q < NUM_QUESTOES; q++)
+        if (strlen(questoes[q].nome) == tamanho && strncmp(questoes[q].nome, nome, tamanho) == 0)
+            return q;
+    return -1;
+}
+
+void ler_opcoes(int argc, char *argv[], int rank, Opcoes *opcoes)
+{
+    opcoes->tamanho_bloco = 64LL << 20;
+    opcoes->dinamico = 0;
+    opcoes->num_threads = 1;
+    opcoes->usar_cache = 0;
+    opcoes->gerar_cache = 0;
+    opcoes->mpi_io = 0;
+    opcoes->incremental = 0;
+    opcoes->metricas = NULL;
+    opcoes->leitura_antecipada = 0;
+    opcoes->leitura.tamanho_buffer = 1LL << 20;
+    opcoes->leitura.profundidade = 4;
+    opcoes->zip = NULL;
+    opcoes->servidor = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bloco-kb") == 0 && i + 1 < argc)
+        {
+            opcoes->tamanho_bloco = atoll(argv[++i]) << 10;
+        }
+        else if (strcmp(argv[i], "--dinamico") == 0)
+        {
+            opcoes->dinamico = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            opcoes->num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            opcoes->usar_cache = 1;
+        }
+        else if (strcmp(argv[i], "--gerar-cache") == 0)
+        {
+            opcoes->gerar_cache = 1;
+            opcoes->usar_cache = 1;
+        }
+        else if (strcmp(argv[i], "--mpi-io") == 0)
+        {
+            opcoes->mpi_io = 1;
+        }
+        else if (strcmp(argv[i], "--incremental") == 0)
+        {
+            opcoes->incremental = 1;
+        }
+        else if (strcmp(argv[i], "--metricas") == 0 && i + 1 < argc)
+        {
+            opcoes->metricas = argv[++i];
+        }
+        else if (strcmp(argv[i], "--leitura-antecipada") == 0)
+        {
+            opcoes->leitura_antecipada = 1;
+        }
+        else if (strcmp(argv[i], "--buffer-kb") == 0 && i + 1 < argc)
+        {
+            opcoes->leitura.tamanho_buffer = atoll(argv[++i]) << 10;
+        }
+        else if (strcmp(argv[i], "--fila") == 0 && i + 1 < argc)
+        {
+            opcoes->leitura.profundidade = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--zip") == 0 && i + 1 < argc)
+        {
+            opcoes->zip = argv[++i];
+        }
+        else if (strcmp(argv[i], "--servidor") == 0 && i + 1 < argc)
+        {
+            opcoes->servidor = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cruzar") == 0 && i + 1 < argc)
+        {
+            // A:B, both among the analyzed questions
+            const char *par = argv[++i];
+            const char *dois_pontos = strchr(par, ':');
+            int a = dois_pontos ? buscar_questao(par, (size_t)(dois_pontos - par)) : -1;
+            int b = dois_pontos ? buscar_questao(dois_pontos + 1, strlen(dois_pontos + 1)) : -1;
+
+            if (a == -1 || b == -1 || num_cruzamentos == MAX_CRUZAMENTOS)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Erro: cruzamento inválido '%s' (use QUESTAO:QUESTAO, no máximo %d).\n", par, MAX_CRUZAMENTOS);
+                MPI_Finalize();
+                exit(1);
+            }
+            cruzamentos[num_cruzamentos].questao_a = a;
+            cruzamentos[num_cruzamentos].questao_b = b;
+            num_cruzamentos++;
+        }
+        else
+        {
+            if (rank == 0)
+                fprintf(stderr, "Uso: %s [--bloco-kb N] [--dinamico] [--threads N] [--cache] [--gerar-cache] [--mpi-io] [--incremental] [--metricas ARQ] [--leitura-antecipada] [--buffer-kb N] [--fila N] [--zip ARQ] [--servidor SOCKET] [--cruzar A:B]...\n", argv[0]);
+            MPI_Finalize();
+            exit(1);
+        }
+    }
+
+    if (opcoes->mpi_io && opcoes->dinamico)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: --mpi-io usa leituras coletivas e não pode ser combinado com --dinamico.\n");
+        MPI_Finalize();
+        exit(1);
+    }
+
+    if (opcoes->servidor && opcoes->incremental)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: --servidor carrega todos os arquivos e não pode ser combinado com --incremental.\n");
+        MPI_Finalize();
+        exit(1);
+    }
+
+    if (opcoes->tamanho_bloco <= 0 || opcoes->num_threads <= 0)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: o tamanho do bloco e o número de threads devem ser positivos.\n");
+        MPI_Finalize();
+        exit(1);
+    }
+
+    if (opcoes->leitura.tamanho_buffer <= 0 || opcoes->leitura.profundidade < 2)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: o buffer de leitura deve ser positivo e a fila deve ter pelo menos 2 buffers.\n");
+        MPI_Finalize();
+        exit(1);
+    }
+
+#ifdef _WIN32
+    if (opcoes->servidor)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: --servidor usa sockets UNIX e não está disponível no Windows.\n");
+        MPI_Finalize();
+        exit(1);
+    }
+#endif
+
+#ifndef COM_ZLIB
+    if (opcoes->zip)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: --zip requer compilação com -DCOM_ZLIB (-lz).\n");
+        MPI_Finalize();
+        exit(1);
+    }
+#endif
+
+#ifndef _OPENMP
+    if (opcoes->num_threads > 1)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Aviso: compilado sem OpenMP (-fopenmp); usando 1 thread por processo.\n");
+        opcoes->num_threads = 1;
+    }
+#endif
+}
+
+// --- Query server ---
+// With --servidor CAMINHO the processes load their share of the rows once into
+// compact in-memory columns and stay resident, answering the queries that
+// arrive on a local UNIX socket instead of printing the fixed report. The rows
+// are split in equal ranges of row index, so the columns of different files
+// (one variable per file in the 2014 microdata) stay aligned on every process
+// and any two questions can be crossed row by row. Each question is kept as the
+// one-byte codes of the columnar cache and each row as the CO_GRUPO of its line
+// in the courses file. Process 0 reads a query and broadcasts it, every process
+// counts its rows and the counters are summed with MPI_Reduce.
+//
+// A query is one line of text and its answer one line of JSON:
+//   alunos [grupo G]            rows (of CO_GRUPO G)
+//   contar QUESTAO [grupo G]    categories, empty and incomplete responses
+//   cruzar A B [grupo G]        contingency table of two questions
+//   encerrar                    stops the server
+#ifndef _WIN32
+
+#define MAX_CONSULTA 1024
+#define ESPERA_MAXIMA_NS 2000000L // Longest sleep of an idle process between polls (2 ms)
+
+typedef enum
+{
+    CONSULTA_ALUNOS,
+    CONSULTA_CONTAR,
+    CONSULTA_CRUZAR,
+    CONSULTA_ENCERRAR
+} TipoConsulta;
+
+typedef struct
+{
+    TipoConsulta tipo;
+    int questao_a, questao_b; // Indices in questoes[]
+    int filtrar_grupo;        // Counts only the rows of CO_GRUPO = grupo
+    int grupo;
+} Consulta;
+
+// Counters of a query, kept as long longs so they are summed with one reduction
+typedef struct
+{
+    long long alunos;    // Rows that pass the filter and have the question
+    long long contadores[MAX_CATEGORIAS];
+    long long vazio;
+    long long invalidas; // Responses outside the categories of the question
+    long long ignoradas; // Rows too short for the question
+    long long tabela[MAX_CATEGORIAS][MAX_CATEGORIAS];
+} RespostaConsulta;
+
+#define NUM_CONTADORES_CONSULTA ((int)(sizeof(RespostaConsulta) / sizeof(long long)))
+
+// Rows of this process, column by column
+typedef struct
+{
+    long long total_linhas;                 // Rows of the data set
+    long long primeira;                     // Index of the first row of this process
+    long long num_linhas;                   // Rows of this process
+    int32_t *grupos;                        // CO_GRUPO of each row, or CACHE_SEM_VALOR
+    unsigned char *respostas[NUM_QUESTOES]; // Cache codes of each question, or NULL if not loaded
+    int *pares;                             // Loading only: sorted (course, group) pairs of all rows
+    int num_pares;
+} TabelaMemoria;
+
+// Rows [primeira_linha(r), primeira_linha(r + 1)) belong to process r
+static long long primeira_linha(long long total, int r, int size)
+{
+    return total * r / size;
+}
+
+// Collective: moves a column from the rows each process parsed (num_locais
+// rows from row primeira_local on) to the processes that own them.
+// Returns the values of the rows of t.
+static void *redistribuir_coluna(const void *locais, long long num_locais, long long primeira_local, int bytes_por_valor, const TabelaMemoria *t, int size)
+{
+    int *envios = calloc(size, sizeof(int)), *desl_envios = calloc(size, sizeof(int));
+    int *recebidos = calloc(size, sizeof(int)), *desl_recebidos = calloc(size, sizeof(int));
+
+    for (int r = 0; r < size; r++)
+    {
+        long long ini = primeira_linha(t->total_linhas, r, size), fim = primeira_linha(t->total_linhas, r + 1, size);
+        if (ini < primeira_local)
+            ini = primeira_local;
+        if (fim > primeira_local + num_locais)
+            fim = primeira_local + num_locais;
+        if (fim > ini)
+        {
+            envios[r] = (int)(fim - ini);
+            desl_envios[r] = (int)(ini - primeira_local);
+        }
+    }
+    MPI_Alltoall(envios, 1, MPI_INT, recebidos, 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r = 1; r < size; r++)
+        desl_recebidos[r] = desl_recebidos[r - 1] + recebidos[r - 1];
+
+    MPI_Datatype tipo;
+    MPI_Type_contiguous(bytes_por_valor, MPI_BYTE, &tipo);
+    MPI_Type_commit(&tipo);
+
+    void *dados = malloc(t->num_linhas > 0 ? t->num_linhas * bytes_por_valor : 1);
+    MPI_Alltoallv(locais, envios, desl_envios, tipo, dados, recebidos, desl_recebidos, tipo, MPI_COMM_WORLD);
+
+    MPI_Type_free(&tipo);
+    free(envios);
+    free(desl_envios);
+    free(recebidos);
+    free(desl_recebidos);
+    return dados;
+}
+
+// Collective: loads the columns of a file (see descrever_colunas()) for the
+// rows of this process. A cache is sliced directly; a text file is parsed by
+// equal shares of its bytes and its rows moved to their owners. The courses
+// file (mapa NULL) sets the rows of t; another file must have as many rows.
+// Returns 0, or -1 if the rows of the file cannot be aligned with t.
+static int carregar_colunas(const char *filename, const MapaColunas *mapa, int em_cache, int rank, int size,
+                            TabelaMemoria *t, CabecalhoCache *cab, void **colunas)
+{
+    int arquivo_cursos = mapa == NULL;
+    ArquivoMapeado arq;
+    if (mapear_arquivo(filename, &arq) != 0)
+    {
+        fprintf(stderr, "Rank %d: Erro ao abrir %s\n", rank, filename);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    memset(colunas, 0, CACHE_MAX_COLUNAS * sizeof(void *));
+    if (em_cache)
+    {
+        *cab = *(const CabecalhoCache *)arq.dados;
+        if (arquivo_cursos)
+        {
+            t->total_linhas = cab->num_linhas;
+            t->primeira = primeira_linha(t->total_linhas, rank, size);
+            t->num_linhas = primeira_linha(t->total_linhas, rank + 1, size) - t->primeira;
+        }
+        else if (cab->num_linhas != t->total_linhas)
+        {
+            desmapear_arquivo(&arq);
+            return -1;
+        }
+
+        // Score columns are not queried and stay unloaded
+        for (int c = 0; c < cab->num_colunas; c++)
+        {
+            if (!arquivo_cursos && c > 0 && cab->colunas[c].questao < 0)
+                continue;
+            long long bytes = t->num_linhas * cab->colunas[c].bytes_por_valor;
+            colunas[c] = malloc(bytes > 0 ? bytes : 1);
+            memcpy(colunas[c], arq.dados + cab->colunas[c].deslocamento + t->primeira * cab->colunas[c].bytes_por_valor, (size_t)bytes);
+        }
+        desmapear_arquivo(&arq);
+        somar_fase(FASE_LEITURA, 0.0, t->num_linhas * (arquivo_cursos ? 8 : cab->num_colunas + 3), t->num_linhas);
+        return 0;
+    }
+
+    MapaColunas mapa_texto;
+    if (mapa)
+    {
+        mapa_texto = *mapa;
+        for (int n = 0; n < NUM_NOTAS; n++)
+            mapa_texto.idx_nota[n] = -1;
+    }
+    int coluna_texto[CACHE_MAX_COLUNAS];
+    descrever_colunas(&mapa_texto, arquivo_cursos, cab, coluna_texto);
+
+    const char *fim_arquivo = arq.dados + arq.tamanho;
+    Scanner scanner;
+    long long inicio_dados = mapa_texto.inicio_dados;
+    if (arquivo_cursos)
+    {
+        scanner_iniciar(&scanner, arq.dados, fim_arquivo);
+        inicio_dados = (long long)(scanner_proxima_linha(&scanner) - arq.dados); // Skips the header
+    }
 
-int cursos_ads[MAX_COURSES];
-int num_cursos_ads = 0;
+    // This process parses the rows that start in its share of the bytes
+    long long dados = (long long)arq.tamanho - inicio_dados;
+    const char *p = inicio_de_linha(&arq, inicio_dados, inicio_dados + dados * rank / size);
+    const char *fim = arq.dados + inicio_dados + dados * (rank + 1) / size;
+    scanner_iniciar(&scanner, p, fim_arquivo);
+
+    long long capacidade = 1 << 16;
+    void *locais[CACHE_MAX_COLUNAS];
+    for (int c = 0; c < cab->num_colunas; c++)
+        locais[c] = malloc(capacidade * cab->colunas[c].bytes_por_valor);
+    ler_colunas_texto(&scanner, p, fim, &mapa_texto, arquivo_cursos, coluna_texto, cab, locais, &capacidade);
+    somar_fase(FASE_LEITURA, 0.0, fim > p ? (long long)(fim - p) : 0, cab->num_linhas);
+    desmapear_arquivo(&arq);
+
+    // The rows parsed by the previous processes give the index of the first one
+    long long num_locais = cab->num_linhas, primeira_local = 0, total = 0;
+    MPI_Exscan(&num_locais, &primeira_local, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&num_locais, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        primeira_local = 0;
+
+    int resultado = 0;
+    if (arquivo_cursos)
+    {
+        t->total_linhas = total;
+        t->primeira = primeira_linha(total, rank, size);
+        t->num_linhas = primeira_linha(total, rank + 1, size) - t->primeira;
+    }
+    else if (total != t->total_linhas)
+    {
+        resultado = -1;
+    }
+
+    for (int c = 0; c < cab->num_colunas; c++)
+    {
+        if (resultado == 0)
+            colunas[c] = redistribuir_coluna(locais[c], num_locais, primeira_local, cab->colunas[c].bytes_por_valor, t, size);
+        free(locais[c]);
+    }
+    cab->num_linhas = total;
+    return resultado;
+}
 
-// Extracts ADS courses (group 72) from the first file
-void extrair_cursos_ads(const char *filename)
+static int comparar_par(const void *a, const void *b)
 {
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
+    const int *x = a, *y = b;
+    return x[0] != y[0] ? (x[0] > y[0]) - (x[0] < y[0]) : (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+// Sorts n (course, group) pairs and drops the repeated ones. Returns the pairs left.
+static int unir_pares(int *pares, int n)
+{
+    qsort(pares, n, 2 * sizeof(int), comparar_par);
+    int unicos = 0;
+    for (int i = 0; i < n; i++)
     {
-        fprintf(stderr, "Rank 0: Erro ao abrir %s para extrair cursos ADS.\n", filename);
-        return;
+        if (unicos > 0 && comparar_par(&pares[2 * i], &pares[2 * (unicos - 1)]) == 0)
+            continue;
+        pares[2 * unicos] = pares[2 * i];
+        pares[2 * unicos + 1] = pares[2 * i + 1];
+        unicos++;
+    }
+    return unicos;
+}
+
+// Group of a course in the (course, group) pairs of t, or CACHE_SEM_VALOR
+static int32_t grupo_do_curso(const TabelaMemoria *t, int32_t co_curso)
+{
+    int chave[2] = {co_curso, INT_MIN};
+    int ini = 0, fim = t->num_pares;
+    while (ini < fim)
+    {
+        int meio = (ini + fim) / 2;
+        if (comparar_par(&t->pares[2 * meio], chave) < 0)
+            ini = meio + 1;
+        else
+            fim = meio;
     }
+    return ini < t->num_pares && t->pares[2 * ini] == co_curso ? t->pares[2 * ini + 1] : CACHE_SEM_VALOR;
+}
 
-    char linha[1024];
-    fgets(linha, sizeof(linha), fp); // Reads the header
+// Gives the rows still without a group the group of their course in another
+// file (cursos is its CO_CURSO column), as the other files are counted by
+// their own CO_CURSO in the report
+static void completar_grupos(TabelaMemoria *t, const int32_t *cursos)
+{
+    for (long long l = 0; l < t->num_linhas; l++)
+        if (t->grupos[l] == CACHE_SEM_VALOR && cursos[l] != CACHE_SEM_VALOR)
+            t->grupos[l] = grupo_do_curso(t, cursos[l]);
+}
 
-    int linhas_ignoradas_ads = 0; // Renamed to avoid confusion with other ignored lines
+// Collective: sets the group of each row of t from the courses file. The
+// (course, group) pairs of the complete lines of every process are gathered,
+// so an incomplete line, without CO_GRUPO, takes the group its course has in
+// other lines, as extrair_cursos_ads() classifies courses.
+static void atribuir_grupos(TabelaMemoria *t, const int32_t *cursos, const int32_t *grupos, int size)
+{
+    int *pares = malloc((t->num_linhas > 0 ? t->num_linhas : 1) * 2 * sizeof(int));
+    int num_pares = 0;
+    for (long long l = 0; l < t->num_linhas; l++)
+    {
+        if (cursos[l] == CACHE_SEM_VALOR || grupos[l] == CACHE_SEM_VALOR)
+            continue;
+        pares[2 * num_pares] = cursos[l];
+        pares[2 * num_pares + 1] = grupos[l];
+        num_pares++;
+    }
+    num_pares = unir_pares(pares, num_pares);
 
-    while (fgets(linha, sizeof(linha), fp))
+    int *contagens = malloc(size * sizeof(int));
+    int *deslocamentos = malloc(size * sizeof(int));
+    int valores = 2 * num_pares, total = 0;
+    MPI_Allgather(&valores, 1, MPI_INT, contagens, 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r = 0; r < size; r++)
     {
-        char copia[1024];
-        strcpy(copia, linha);
+        deslocamentos[r] = total;
+        total += contagens[r];
+    }
+    t->pares = malloc((total > 0 ? total : 1) * sizeof(int));
+    MPI_Allgatherv(pares, valores, MPI_INT, t->pares, contagens, deslocamentos, MPI_INT, MPI_COMM_WORLD);
+    t->num_pares = unir_pares(t->pares, total / 2);
 
-        int col = 0;
-        int co_grupo = -1, co_curso = -1;
+    t->grupos = malloc((t->num_linhas > 0 ? t->num_linhas : 1) * sizeof(int32_t));
+    memcpy(t->grupos, grupos, t->num_linhas * sizeof(int32_t));
+    completar_grupos(t, cursos);
 
-        // --- First pass to count columns and check integrity ---
-        char *token_tmp = strtok(copia, ";");
-        int num_colunas = 0;
-        while (token_tmp != NULL)
-        {
-            num_colunas++;
-            token_tmp = strtok(NULL, ";");
-        }
+    free(deslocamentos);
+    free(contagens);
+    free(pares);
+}
 
-        // We need columns 2 (CO_CURSO) and 6 (CO_GRUPO)
-        if (num_colunas < 6 || num_colunas < 2)
-        {
-            linhas_ignoradas_ads++;
-            continue; // Ignores incomplete lines
-        }
+// Collective: loads the rows of this process from the courses file and every
+// file with questions. Compressed files, and files whose row count differs from
+// the courses file, cannot be aligned by row and are left out.
+// Returns -1 if the courses file cannot be loaded.
+int carregar_tabela(char arquivos[][MAX_FILENAME], const MapaColunas *mapas, const char *cursos, int cursos_em_cache,
+                    int rank, int size, TabelaMemoria *t)
+{
+    memset(t, 0, sizeof(*t));
+    CabecalhoCache cab;
+    void *colunas[CACHE_MAX_COLUNAS];
+
+    carregar_colunas(cursos, NULL, cursos_em_cache, rank, size, t, &cab, colunas);
+    int valido = cab.num_colunas == 2 && strcmp(cab.colunas[1].nome, "CO_GRUPO") == 0;
+    if (valido)
+        atribuir_grupos(t, colunas[0], colunas[1], size);
+    for (int c = 0; c < CACHE_MAX_COLUNAS; c++)
+        free(colunas[c]);
+    if (!valido)
+        return -1;
 
-        // --- Second pass to extract values ---
-        strcpy(copia, linha);           // Restores the line for strtok again
-        token_tmp = strtok(copia, ";"); // Re-tokenizes
-        col = 0;                        // Resets the column counter
+    for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+    {
+        if (mapas[i].tamanho <= 0)
+            continue;
 
-        while (token_tmp != NULL)
+        if (mapas[i].entrada.formato != FORMATO_TEXTO ||
+            carregar_colunas(arquivos[i], &mapas[i], mapas[i].em_cache, rank, size, t, &cab, colunas) != 0)
         {
-            col++;
-            if (col == 2)
-                co_curso = atoi(token_tmp);
-            if (col == 6)
-                co_grupo = atoi(token_tmp);
-            token_tmp = strtok(NULL, ";");
+            if (rank == 0)
+                fprintf(stderr, "Aviso: %s ignorado pelo servidor: %s.\n", arquivos[i],
+                        mapas[i].entrada.formato != FORMATO_TEXTO ? "arquivos comprimidos não são carregados" : "número de linhas diferente do arquivo de cursos");
+            continue;
         }
 
-        if (co_grupo == 72 && num_cursos_ads < MAX_COURSES)
+        completar_grupos(t, colunas[0]);
+        free(colunas[0]);
+        for (int c = 1; c < cab.num_colunas; c++)
         {
-            cursos_ads[num_cursos_ads++] = co_curso;
+            int q = cab.colunas[c].questao;
+            if (q >= 0 && q < NUM_QUESTOES && !t->respostas[q])
+                t->respostas[q] = colunas[c];
+            else
+                free(colunas[c]);
         }
     }
 
-    if (linhas_ignoradas_ads > 0)
-        printf("extrair_cursos_ads: Ignoradas %d linhas incompletas no arquivo de cursos ADS.\n", linhas_ignoradas_ads);
-
-    fclose(fp);
+    free(t->pares);
+    t->pares = NULL;
+    return 0;
 }
 
-// Generic function to count responses for a question
-// Now includes a counter for empty responses (ultimo_contador_vazio)
-void contar_respostas(const char *filename, const char *questao, int tamanho_contadores, int *contadores, int *linhas_ignoradas, int *num_alunos_ads_total_local, int *ultimo_contador_vazio)
+void liberar_tabela(TabelaMemoria *t)
 {
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
-    {
-        fprintf(stderr, "Erro ao abrir %s\n", filename);
-        return;
-    }
+    free(t->pares);
+    free(t->grupos);
+    for (int q = 0; q < NUM_QUESTOES; q++)
+        free(t->respostas[q]);
+}
 
-    char linha[2048];
-    int idx_questao = -1;
-    int idx_co_curso = -1;
+// Counts the rows of this process for a query, split among the threads
+static void responder_consulta_local(const TabelaMemoria *t, const Consulta *c, int num_threads, RespostaConsulta *r)
+{
+    const unsigned char *a = c->tipo == CONSULTA_ALUNOS ? NULL : t->respostas[c->questao_a];
+    const unsigned char *b = c->tipo == CONSULTA_CRUZAR ? t->respostas[c->questao_b] : NULL;
+    memset(r, 0, sizeof(*r));
+    (void)num_threads;
 
-    // Reads the header to find the index of the question column
-    if (fgets(linha, sizeof(linha), fp))
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif
     {
-        char *copia = strdup(linha);
-        char *token = strtok(copia, ";");
-        int col = 0;
-        while (token != NULL)
+        RespostaConsulta local;
+        memset(&local, 0, sizeof(local));
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (long long l = 0; l < t->num_linhas; l++)
         {
-            col++;
-            token[strcspn(token, "\r\n")] = 0;
-            if (token[0] == '"')
-                memmove(token, token + 1, strlen(token));
-            if (token[strlen(token) - 1] == '"')
-                token[strlen(token) - 1] = '\0';
+            if (c->filtrar_grupo && t->grupos[l] != c->grupo)
+                continue;
+            if (!a)
+            {
+                local.alunos++;
+                continue;
+            }
 
-            if (strcmp(token, questao) == 0)
+            unsigned char codigo = a[l];
+            if (codigo == CACHE_AUSENTE)
             {
-                idx_questao = col;
+                local.ignoradas++;
+                continue;
             }
-            if (strcmp(token, "CO_CURSO") == 0)
+            local.alunos++;
+
+            if (codigo == CACHE_VAZIO)
+                local.vazio++;
+            else if (codigo == CACHE_INVALIDO)
+                local.invalidas++;
+            else
             {
-                idx_co_curso = col;
+                local.contadores[codigo]++;
+                if (b && b[l] < MAX_CATEGORIAS)
+                    local.tabela[codigo][b[l]]++;
             }
-            token = strtok(NULL, ";");
         }
-        free(copia);
+
+#ifdef _OPENMP
+#pragma omp critical(somar_consulta)
+#endif
+        {
+            long long *d = (long long *)r;
+            const long long *o = (const long long *)&local;
+            for (int i = 0; i < NUM_CONTADORES_CONSULTA; i++)
+                d[i] += o[i];
+        }
     }
+}
 
-    // If the question or CO_CURSO was not found in the header, we cannot process
-    if (idx_questao == -1)
+// Waits for a request without the busy polling most MPI libraries do inside
+// blocking calls: tests it and sleeps in between, from 50 us doubling up to
+// ESPERA_MAXIMA_NS. An idle server then costs next to no CPU, and a query
+// that arrives after a pause starts at most that much later.
+static void esperar_pedido(MPI_Request *pedido)
+{
+    long espera = 50000;
+    int pronto = 0;
+    MPI_Test(pedido, &pronto, MPI_STATUS_IGNORE);
+    while (!pronto)
     {
-        fprintf(stderr, "Aviso: Questão '%s' não encontrada no cabeçalho de %s. Arquivo ignorado para esta questão.\n", questao, filename);
-        fclose(fp);
-        return;
+        struct timespec pausa = {0, espera};
+        nanosleep(&pausa, NULL);
+        if (espera < ESPERA_MAXIMA_NS)
+            espera = espera * 2 < ESPERA_MAXIMA_NS ? espera * 2 : ESPERA_MAXIMA_NS;
+        MPI_Test(pedido, &pronto, MPI_STATUS_IGNORE);
     }
+}
 
-    // Check if CO_CURSO is found. It's essential for filtering.
-    if (idx_co_curso == -1)
+// Collective: process 0 passes the query in c, every process counts its rows
+// and the counters are summed into r on process 0. Returns 0 when the query
+// stops the server. The other processes spend the idle time between queries
+// here, so they wait in esperar_pedido().
+static int executar_consulta(Consulta *c, const TabelaMemoria *t, int num_threads, RespostaConsulta *r)
+{
+    int rank;
+    MPI_Request pedido;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Ibcast(c, sizeof(Consulta), MPI_BYTE, 0, MPI_COMM_WORLD, &pedido);
+    if (rank == 0)
+        MPI_Wait(&pedido, MPI_STATUS_IGNORE);
+    else
+        esperar_pedido(&pedido);
+    if (c->tipo == CONSULTA_ENCERRAR)
+        return 0;
+
+    RespostaConsulta local;
+    responder_consulta_local(t, c, num_threads, &local);
+    MPI_Reduce(&local, r, NUM_CONTADORES_CONSULTA, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    return 1;
+}
+
+// Parses a query line into c. Returns 1 for a query, 0 for a blank line and -1
+// with a message in erro for an invalid one.
+static int interpretar_consulta(char *linha, const TabelaMemoria *t, Consulta *c, char *erro, size_t tamanho_erro)
+{
+    memset(c, 0, sizeof(*c));
+    char *palavras[6];
+    int n = 0;
+    for (char *p = strtok(linha, " \t\r\n"); p; p = strtok(NULL, " \t\r\n"))
     {
-        fprintf(stderr, "Aviso: Coluna 'CO_CURSO' não encontrada no cabeçalho de %s. Arquivo ignorado.\n", filename);
-        fclose(fp);
-        return;
+        if (n == 6)
+        {
+            snprintf(erro, tamanho_erro, "consulta longa demais");
+            return -1;
+        }
+        palavras[n++] = p;
     }
+    if (n == 0)
+        return 0;
 
-    *linhas_ignoradas = 0; // Resets the counter of ignored lines for this file/question
+    int questoes_consulta;
+    if (strcmp(palavras[0], "alunos") == 0)
+    {
+        c->tipo = CONSULTA_ALUNOS;
+        questoes_consulta = 0;
+    }
+    else if (strcmp(palavras[0], "contar") == 0)
+    {
+        c->tipo = CONSULTA_CONTAR;
+        questoes_consulta = 1;
+    }
+    else if (strcmp(palavras[0], "cruzar") == 0)
+    {
+        c->tipo = CONSULTA_CRUZAR;
+        questoes_consulta = 2;
+    }
+    else if (strcmp(palavras[0], "encerrar") == 0 && n == 1)
+    {
+        c->tipo = CONSULTA_ENCERRAR;
+        return 1;
+    }
+    else
+    {
+        snprintf(erro, tamanho_erro, "consulta desconhecida (use alunos, contar, cruzar ou encerrar)");
+        return -1;
+    }
 
-    // Reads data lines
-    while (fgets(linha, sizeof(linha), fp))
+    int resto = n - 1 - questoes_consulta;
+    if (resto != 0 && !(resto == 2 && strcmp(palavras[n - 2], "grupo") == 0))
     {
-        char copia_linha[2048];
-        strcpy(copia_linha, linha); // Works on a copy of the line
+        snprintf(erro, tamanho_erro, "uso: alunos | contar QUESTAO | cruzar A B, seguidos opcionalmente de grupo G");
+        return -1;
+    }
 
-        // --- First pass to count columns and validate integrity ---
-        int num_colunas = 0;
-        char *token_tmp = strtok(copia_linha, ";");
-        while (token_tmp != NULL)
+    for (int i = 0; i < questoes_consulta; i++)
+    {
+        const char *nome = palavras[1 + i];
+        int q = buscar_questao(nome, strlen(nome));
+        if (q == -1 || !t->respostas[q])
         {
-            num_colunas++;
-            token_tmp = strtok(NULL, ";");
+            snprintf(erro, tamanho_erro, "questão %s não analisada ou não carregada", nome);
+            return -1;
         }
+        if (i == 0)
+            c->questao_a = q;
+        else
+            c->questao_b = q;
+    }
 
-        // The line must have at least the course and question columns
-        if (num_colunas < idx_questao || num_colunas < idx_co_curso)
+    if (resto == 2)
+    {
+        char *fim;
+        long grupo = strtol(palavras[n - 1], &fim, 10);
+        if (*fim != '\0' || fim == palavras[n - 1] || grupo < INT_MIN + 1 || grupo > INT_MAX)
         {
-            (*linhas_ignoradas)++;
-            continue; // Ignores incomplete line
+            snprintf(erro, tamanho_erro, "grupo inválido '%s'", palavras[n - 1]);
+            return -1;
         }
+        c->filtrar_grupo = 1;
+        c->grupo = (int)grupo;
+    }
+    return 1;
+}
 
-        // --- Second pass to extract relevant values ---
-        strcpy(copia_linha, linha);             // Restores the original line for strtok again
-        char *token = strtok(copia_linha, ";"); // Re-tokenizes
-        int col = 0;                            // Resets the column counter
-        int co_curso = -1;
-        char resposta[20] = {0}; // Buffer for the current question's response
+// Writes s as a JSON string, quotes included. Messages may echo client input,
+// so quotes, backslashes and control characters are escaped and bytes that are
+// not valid UTF-8 become U+FFFD.
+static void escrever_texto_json(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+        {
+            fprintf(fp, "\\%c", *p);
+            continue;
+        }
+        if (*p < 0x20 || *p == 0x7F)
+        {
+            fprintf(fp, "\\u%04x", *p);
+            continue;
+        }
+        if (*p < 0x80)
+        {
+            fputc(*p, fp);
+            continue;
+        }
 
-        while (token != NULL)
+        int n = *p >= 0xC2 && *p <= 0xDF ? 2 : *p >= 0xE0 && *p <= 0xEF ? 3 : *p >= 0xF0 && *p <= 0xF4 ? 4 : 0;
+        int valido = n > 0;
+        for (int i = 1; valido && i < n; i++)
+            valido = (p[i] & 0xC0) == 0x80;
+        if (!valido)
         {
-            col++;
-            if (col == idx_co_curso)
-                co_curso = atoi(token); // CO_CURSO is the 2nd column
-            if (col == idx_questao)
-            {
-                strncpy(resposta, token, sizeof(resposta) - 1);
-                resposta[sizeof(resposta) - 1] = '\0'; // Ensures null-termination
-                // Removes newlines and extra quotes
-                resposta[strcspn(resposta, "\r\n")] = 0;
-                if (resposta[0] == '"')
-                    memmove(resposta, resposta + 1, strlen(resposta));
-                if (strlen(resposta) > 0 && resposta[strlen(resposta) - 1] == '"')
-                    resposta[strlen(resposta) - 1] = '\0';
-            }
-            token = strtok(NULL, ";");
+            fprintf(fp, "\\ufffd");
+            continue;
         }
+        fwrite(p, 1, n, fp);
+        p += n - 1;
+    }
+    fputc('"', fp);
+}
 
-        // Checks if the course is valid (is among the extracted ADS courses)
-        int curso_valido = 0;
-        for (int i = 0; i < num_cursos_ads; i++)
+// Writes the answer to a query as one line of JSON
+static void escrever_resposta(FILE *fp, const Consulta *c, const RespostaConsulta *r, double segundos)
+{
+    static const char *nomes_consultas[] = {"alunos", "contar", "cruzar"};
+    char rotulo[8];
+
+    fprintf(fp, "{\"consulta\": \"%s\"", nomes_consultas[c->tipo]);
+    if (c->filtrar_grupo)
+        fprintf(fp, ", \"grupo\": %d", c->grupo);
+    else
+        fprintf(fp, ", \"grupo\": null");
+
+    const Questao *a = &questoes[c->questao_a], *b = &questoes[c->questao_b];
+    if (c->tipo == CONSULTA_CONTAR)
+    {
+        fprintf(fp, ", \"questao\": \"%s\", \"alunos\": %lld, \"categorias\": {", a->nome, r->alunos);
+        for (int i = 0; i < a->num_categorias; i++)
         {
-            if (co_curso == cursos_ads[i])
-            {
-                curso_valido = 1;
-                break;
-            }
+            rotulo_categoria(a, i, rotulo, sizeof(rotulo));
+            fprintf(fp, "%s\"%s\": %lld", i ? ", " : "", rotulo, r->contadores[i]);
+        }
+        fprintf(fp, "}, \"vazio\": %lld, \"invalidas\": %lld, \"ignoradas\": %lld", r->vazio, r->invalidas, r->ignoradas);
+    }
+    else if (c->tipo == CONSULTA_CRUZAR)
+    {
+        fprintf(fp, ", \"linhas\": \"%s\", \"colunas\": \"%s\", \"alunos\": %lld, \"rotulos_linhas\": [", a->nome, b->nome, r->alunos);
+        for (int i = 0; i < a->num_categorias; i++)
+        {
+            rotulo_categoria(a, i, rotulo, sizeof(rotulo));
+            fprintf(fp, "%s\"%s\"", i ? ", " : "", rotulo);
+        }
+        fprintf(fp, "], \"rotulos_colunas\": [");
+        for (int j = 0; j < b->num_categorias; j++)
+        {
+            rotulo_categoria(b, j, rotulo, sizeof(rotulo));
+            fprintf(fp, "%s\"%s\"", j ? ", " : "", rotulo);
+        }
+        fprintf(fp, "], \"tabela\": [");
+        for (int i = 0; i < a->num_categorias; i++)
+        {
+            fprintf(fp, "%s[", i ? ", " : "");
+            for (int j = 0; j < b->num_categorias; j++)
+                fprintf(fp, "%s%lld", j ? ", " : "", r->tabela[i][j]);
+            fprintf(fp, "]");
         }
+        fprintf(fp, "]");
+    }
+    else
+    {
+        fprintf(fp, ", \"alunos\": %lld", r->alunos);
+    }
+    fprintf(fp, ", \"segundos\": %.6f}\n", segundos);
+}
+
+// Process 0: accepts clients on the socket, one at a time, and runs their
+// queries until one sends "encerrar". The caller then stops the other
+// processes. Returns -1 if the socket cannot be opened.
+static int servir_consultas(const char *caminho, const TabelaMemoria *t, int num_threads)
+{
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    if (strlen(caminho) >= sizeof(endereco.sun_path))
+    {
+        fprintf(stderr, "Erro: caminho do socket longo demais: %s\n", caminho);
+        return -1;
+    }
+    strcpy(endereco.sun_path, caminho);
+
+    // A socket left by an earlier server is replaced; any other file is kept
+    struct stat st;
+    if (lstat(caminho, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "Erro: %s: caminho já existe e não é um socket.\n", caminho);
+            return -1;
+        }
+        unlink(caminho);
+    }
+
+    int servidor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (servidor < 0 || bind(servidor, (struct sockaddr *)&endereco, sizeof(endereco)) != 0 || listen(servidor, 8) != 0)
+    {
+        fprintf(stderr, "Erro ao abrir o socket %s: %s\n", caminho, strerror(errno));
+        if (servidor >= 0)
+            close(servidor);
+        return -1;
+    }
+    struct stat criado;
+    int identificado = lstat(caminho, &criado) == 0;
 
-        // If it is an ADS student, process the response
-        if (curso_valido)
+    // A client that leaves early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    printf("Servidor aguardando consultas em %s.\n", caminho);
+    fflush(stdout);
+
+    int ativo = 1;
+    while (ativo)
+    {
+        int cliente = accept(servidor, NULL, NULL);
+        if (cliente < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Erro ao aceitar conexão em %s: %s\n", caminho, strerror(errno));
+            break;
+        }
+
+        FILE *entrada = fdopen(cliente, "r");
+        FILE *saida = fdopen(dup(cliente), "w");
+        char linha[MAX_CONSULTA], erro[256];
+        while (ativo && fgets(linha, sizeof(linha), entrada))
         {
-            // Increments the total ADS student counter once per line
-            if (strcmp(questao, "QE_I15") == 0)
+            Consulta c;
+            RespostaConsulta r;
+            int lida = interpretar_consulta(linha, t, &c, erro, sizeof(erro));
+            if (lida == 0)
+                continue;
+            if (lida < 0)
             {
-                (*num_alunos_ads_total_local)++; // Increments the total ADS students who passed the filter
+                fprintf(saida, "{\"erro\": ");
+                escrever_texto_json(saida, erro);
+                fprintf(saida, "}\n");
+                fflush(saida);
+                continue;
             }
 
-            if (strlen(resposta) == 0)
-            {                               // If the response is empty
-                (*ultimo_contador_vazio)++; // Increments the counter for empty responses
+            if (c.tipo == CONSULTA_ENCERRAR)
+            {
+                ativo = 0;
+                fprintf(saida, "{\"encerrado\": true}\n");
             }
             else
-            { // If there is a response, categorize it
-                if (strcmp(questao, "TP_SEXO") == 0)
-                {
-                    if (strcmp(resposta, "M") == 0 && tamanho_contadores > 0)
-                        contadores[0]++;
-                    else if (strcmp(resposta, "F") == 0 && tamanho_contadores > 1)
-                        contadores[1]++;
-                }
-                else if (strcmp(questao, "QE_I21") == 0)
-                {
-                    if (strcmp(resposta, "A") == 0 && tamanho_contadores > 0)
-                        contadores[0]++;
-                    else if (strcmp(resposta, "B") == 0 && tamanho_contadores > 1)
-                        contadores[1]++;
-                }
-                else if (strcmp(questao, "TP_PR_GER") == 0)
-                {
-                    int resp_int = atoi(resposta);
-                    if (resp_int == 222 && tamanho_contadores > 0)
-                        contadores[0]++;
-                    else if (resp_int == 333 && tamanho_contadores > 1)
-                        contadores[1]++;
-                    else if (resp_int == 444 && tamanho_contadores > 2)
-                        contadores[2]++;
-                    else if (resp_int == 555 && tamanho_contadores > 3)
-                        contadores[3]++;
-                    else if (resp_int == 556 && tamanho_contadores > 4)
-                        contadores[4]++;
-                }
-                else
-                {
-                    switch (resposta[0])
-                    {
-                    case 'A':
-                        if (tamanho_contadores > 0)
-                            contadores[0]++;
-                        break;
-                    case 'B':
-                        if (tamanho_contadores > 1)
-                            contadores[1]++;
-                        break;
-                    case 'C':
-                        if (tamanho_contadores > 2)
-                            contadores[2]++;
-                        break;
-                    case 'D':
-                        if (tamanho_contadores > 3)
-                            contadores[3]++;
-                        break;
-                    case 'E':
-                        if (tamanho_contadores > 4)
-                            contadores[4]++;
-                        break;
-                    case 'F':
-                        if (tamanho_contadores > 5)
-                            contadores[5]++;
-                        break;
-                    case 'G':
-                        if (tamanho_contadores > 6)
-                            contadores[6]++;
-                        break;
-                    default:
-                        break;
-                    }
-                }
+            {
+                double inicio = MPI_Wtime();
+                executar_consulta(&c, t, num_threads, &r);
+                escrever_resposta(saida, &c, &r, MPI_Wtime() - inicio);
             }
+            fflush(saida);
         }
+        fclose(saida);
+        fclose(entrada);
     }
 
-    fclose(fp);
+    // Removes the socket only if it is still the one created above
+    close(servidor);
+    if (identificado && lstat(caminho, &st) == 0 && S_ISSOCK(st.st_mode) &&
+        st.st_dev == criado.st_dev && st.st_ino == criado.st_ino)
+        unlink(caminho);
+    return 0;
+}
+
+// Collective: loads the table and serves queries until "encerrar".
+// Returns -1 if the data cannot be loaded or the socket opened.
+int executar_servidor(const char *caminho, char arquivos[][MAX_FILENAME], const MapaColunas *mapas, const char *cursos,
+                      int cursos_em_cache, int rank, int size, int num_threads)
+{
+    double inicio = MPI_Wtime();
+    TabelaMemoria tabela;
+    if (carregar_tabela(arquivos, mapas, cursos, cursos_em_cache, rank, size, &tabela) != 0)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Erro: o servidor requer o arquivo de cursos %s em texto ou no cache.\n", cursos);
+        liberar_tabela(&tabela);
+        return -1;
+    }
+    somar_fase(FASE_LEITURA, MPI_Wtime() - inicio, 0, 0);
+
+    int resultado = 0;
+    if (rank == 0)
+    {
+        printf("Servidor: %lld linhas carregadas em %.2f s por %d processos. Questões:", tabela.total_linhas, MPI_Wtime() - inicio, size);
+        for (int q = 0; q < NUM_QUESTOES; q++)
+            if (tabela.respostas[q])
+                printf(" %s", questoes[q].nome);
+        printf("\n");
+        resultado = servir_consultas(caminho, &tabela, num_threads);
+
+        // The other processes wait for queries until told to stop
+        Consulta fim = {CONSULTA_ENCERRAR, 0, 0, 0, 0};
+        executar_consulta(&fim, &tabela, num_threads, NULL);
+    }
+    else
+    {
+        Consulta c;
+        RespostaConsulta r;
+        while (executar_consulta(&c, &tabela, num_threads, &r))
+            ;
+    }
+
+    MPI_Bcast(&resultado, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    liberar_tabela(&tabela);
+    return resultado;
 }
 
+#endif
+
 int main(int argc, char *argv[])
 {
     int rank, size;
     char arquivos[TOTAL_ARQUIVOS][MAX_FILENAME];
+    char caches[TOTAL_ARQUIVOS][MAX_FILENAME];
+    char salvos[TOTAL_ARQUIVOS][MAX_FILENAME];
+    char fontes[TOTAL_ARQUIVOS][MAX_FILENAME];
+    Entrada entradas[TOTAL_ARQUIVOS];
 
-    // Local counters for questions and empty responses
-    int contadores_QE_I15_local[6] = {0}; // A-F
-    int contadores_QE_I15_vazio_local = 0;
-    int contadores_QE_I22_local[5] = {0}; // A-E
-    int contadores_QE_I22_vazio_local = 0;
-    int contadores_QE_I23_local[5] = {0}; // A-E
-    int contadores_QE_I23_vazio_local = 0;
-    int contadores_TP_SEXO_local[2] = {0}; // M, F
-    int contadores_TP_SEXO_vazio_local = 0;
-    int contadores_QE_I18_local[5] = {0}; // A-E
-    int contadores_QE_I18_vazio_local = 0;
-    int contadores_QE_I19_local[7] = {0}; // A-G
-    int contadores_QE_I19_vazio_local = 0;
-    int contadores_QE_I21_local[2] = {0}; // A, B
-    int contadores_QE_I21_vazio_local = 0;
-    int contadores_TP_PR_GER_local[5] = {0}; // 222, 333, 444, 555, 556
-    int contadores_TP_PR_GER_vazio_local = 0;
-
-    // Global counters
-    int contadores_QE_I15_global[6] = {0};
-    int contadores_QE_I15_vazio_global = 0;
-    int contadores_QE_I22_global[5] = {0};
-    int contadores_QE_I22_vazio_global = 0;
-    int contadores_QE_I23_global[5] = {0};
-    int contadores_QE_I23_vazio_global = 0;
-    int contadores_TP_SEXO_global[2] = {0};
-    int contadores_TP_SEXO_vazio_global = 0;
-    int contadores_QE_I18_global[5] = {0};
-    int contadores_QE_I18_vazio_global = 0;
-    int contadores_QE_I19_global[7] = {0};
-    int contadores_QE_I19_vazio_global = 0;
-    int contadores_QE_I21_global[2] = {0};
-    int contadores_QE_I21_vazio_global = 0;
-    int contadores_TP_PR_GER_global[5] = {0};
-    int contadores_TP_PR_GER_vazio_global = 0;
-
-    // Counters for ignored incomplete lines
-    int ignoradas_I15_local = 0, ignoradas_I22_local = 0, ignoradas_I23_local = 0;
-    int ignoradas_SEXO_local = 0, ignoradas_I18_local = 0, ignoradas_I19_local = 0, ignoradas_I21_local = 0;
-    int ignoradas_I15_global = 0, ignoradas_I22_global = 0, ignoradas_I23_global = 0;
-    int ignoradas_SEXO_global = 0, ignoradas_I18_global = 0, ignoradas_I19_global = 0, ignoradas_I21_global = 0;
-    int ignoradas_PR_GER_local = 0, ignoradas_PR_GER_global = 0;
-
-    // Total counter for analyzed ADS students (global)
-    int total_alunos_ads_local = 0;
-    int total_alunos_ads_global = 0;
+    // Local and global counters for every question and the total of ADS students
+    Resultados resultados_local = {0};
+    Resultados resultados_global = {0};
 
+#ifdef _OPENMP
+    // Threads only call MPI in dynamic mode, one at a time
+    int nivel_threads;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &nivel_threads);
+#else
     MPI_Init(&argc, &argv);
+#endif
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    double inicio_total = MPI_Wtime();
+
+    Opcoes opcoes;
+    ler_opcoes(argc, argv, rank, &opcoes);
+
+#ifdef _OPENMP
+    if (opcoes.dinamico && opcoes.num_threads > 1 && nivel_threads < MPI_THREAD_SERIALIZED)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Aviso: a implementação MPI não suporta MPI_THREAD_SERIALIZED; usando 1 thread por processo.\n");
+        opcoes.num_threads = 1;
+    }
+#endif
+
+    selecionar_kernel_scanner();
 
     // Mounts the names of the files to be read
     for (int i = 0; i < TOTAL_ARQUIVOS; i++)
     {
         snprintf(arquivos[i], MAX_FILENAME,
                  "2.DADOS/microdados2014_arq%d.txt", i + 1);
+        snprintf(caches[i], MAX_FILENAME,
+                 "2.DADOS/cache/microdados2014_arq%d.col", i + 1);
+        snprintf(salvos[i], MAX_FILENAME,
+                 "2.DADOS/resultados/microdados2014_arq%d.res", i + 1);
+    }
+
+    // Inputs missing as text are read from the zip archive or a compressed copy
+    localizar_entradas(arquivos, TOTAL_ARQUIVOS, opcoes.zip, fontes, entradas);
+
+    // Optional ingest step: the files are split among processes and each one
+    // converts its files into the columnar cache
+    if (opcoes.gerar_cache)
+    {
+        if (rank == 0)
+            criar_diretorio("2.DADOS/cache");
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        int gerados_local = 0, gerados_global = 0;
+        for (int i = rank; i < TOTAL_ARQUIVOS; i += size)
+        {
+            int resultado = gerar_cache(arquivos[i], caches[i], i == 0);
+            if (resultado == 0)
+                gerados_local++;
+            else if (resultado < 0)
+                fprintf(stderr, "Erro ao gerar o cache de %s em %s\n", arquivos[i], caches[i]);
+        }
+
+        // Completes only after every process has written its files
+        MPI_Reduce(&gerados_local, &gerados_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0)
+            printf("Cache colunar gerado para %d arquivos em 2.DADOS/cache.\n", gerados_global);
     }
 
-    // Process 0 extracts ADS courses for all processes to use
+    // All processes extract ADS courses from their share of the first file and
+    // merge them, so no process waits for a serial scan
+    double inicio_fase = MPI_Wtime();
+    CabecalhoCache cab_cursos;
+    int ignoradas_cursos_local = -1, ignoradas_cursos_global = 0;
+    if (opcoes.usar_cache && validar_cache(arquivos[0], caches[0], &cab_cursos))
+        ignoradas_cursos_local = extrair_cursos_ads_cache(caches[0], rank, size);
+    int cursos_em_cache = ignoradas_cursos_local >= 0;
+    if (ignoradas_cursos_local < 0 && entradas[0].formato != FORMATO_TEXTO)
+        ignoradas_cursos_local = extrair_cursos_ads_comprimido(fontes[0], &entradas[0], rank);
+    if (ignoradas_cursos_local < 0)
+        ignoradas_cursos_local = extrair_cursos_ads(arquivos[0], rank, size);
+
+    unir_cursos_ads(size);
+
+    MPI_Reduce(&ignoradas_cursos_local, &ignoradas_cursos_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    somar_fase(FASE_CURSOS, MPI_Wtime() - inicio_fase, 0, 0);
     if (rank == 0)
     {
-        extrair_cursos_ads(arquivos[0]);
+        if (ignoradas_cursos_global > 0)
+            printf("extrair_cursos_ads: Ignoradas %d linhas incompletas no arquivo de cursos ADS.\n", ignoradas_cursos_global);
         printf("Rank 0: Encontrados %d cursos de ADS (CO_GRUPO=72).\n", num_cursos_ads);
     }
 
-    // Distributes course data to all processes
-    MPI_Bcast(&num_cursos_ads, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(cursos_ads, num_cursos_ads, MPI_INT, 0, MPI_COMM_WORLD);
+    // Process 0 reads the header of every file (except file 0, which was used to
+    // extract courses) and shares the column maps with all processes. With
+    // --cache, files with a valid cache are counted from it instead.
+    inicio_fase = MPI_Wtime();
+    MapaColunas mapas[TOTAL_ARQUIVOS];
+    memset(mapas, 0, sizeof(mapas));
+    if (rank == 0)
+    {
+        for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+        {
+            CabecalhoCache cab;
+            if (opcoes.usar_cache && validar_cache(arquivos[i], caches[i], &cab))
+            {
+                ler_cabecalho_cache(&cab, &mapas[i]);
+                continue;
+            }
+
+            if (entradas[i].formato != FORMATO_TEXTO)
+                ler_cabecalho_comprimido(fontes[i], &entradas[i], &mapas[i]);
+            else
+                ler_cabecalho(arquivos[i], &mapas[i]);
+            if (opcoes.usar_cache && mapas[i].tamanho > 0)
+                fprintf(stderr, "Aviso: cache ausente ou desatualizado para %s; usando o arquivo de texto.\n", arquivos[i]);
+        }
+    }
+    if (rank == 0)
+        localizar_cruzamentos(mapas, TOTAL_ARQUIVOS);
+
+    // With --incremental, process 0 loads the stored counters of the files that
+    // did not change and leaves them out of the partition. The hash of every
+    // file to be counted is taken now, so it matches the contents counted;
+    // the files are hashed by all processes, in hashear_arquivos().
+    ResultadoArquivo *registros = NULL;
+    int reaproveitado[TOTAL_ARQUIVOS] = {0};
+    char a_hashear[TOTAL_ARQUIVOS][MAX_FILENAME] = {{0}};
+    long long tamanhos_hash[TOTAL_ARQUIVOS] = {0};
+    if (opcoes.incremental && rank == 0)
+    {
+        registros = calloc(TOTAL_ARQUIVOS, sizeof(ResultadoArquivo));
+        const char *origens[TOTAL_ARQUIVOS] = {NULL};
+        int identificado[TOTAL_ARQUIVOS] = {0};
+        long long metadados[TOTAL_ARQUIVOS][2] = {{0}};
+        for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+            if (mapas[i].tamanho > 0)
+                identificado[i] = origem_resultado(arquivos[i], caches[i], fontes[i], &entradas[i],
+                                                   &origens[i], &metadados[i][0], &metadados[i][1]) == 0;
+
+        int num_reaproveitados = 0, num_analisados = 0;
+        for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+        {
+            if (mapas[i].tamanho <= 0 || !identificado[i])
+                continue;
+
+            unsigned long long assinatura = assinatura_resultados(mapas, i, metadados);
+            if (carregar_resultado(salvos[i], origens[i], metadados[i][0], metadados[i][1], assinatura, &registros[i]))
+            {
+                reaproveitado[i] = 1;
+                num_reaproveitados++;
+                continue;
+            }
+
+            memset(&registros[i], 0, sizeof(ResultadoArquivo));
+            memcpy(registros[i].magica, RESULTADOS_MAGICA, sizeof(registros[i].magica));
+            registros[i].versao = RESULTADOS_VERSAO;
+            registros[i].tamanho = metadados[i][0];
+            registros[i].mtime = metadados[i][1];
+            registros[i].hash = entradas[i].crc;
+            if (origens[i])
+            {
+                snprintf(a_hashear[i], MAX_FILENAME, "%s", origens[i]);
+                tamanhos_hash[i] = metadados[i][0];
+            }
+            registros[i].assinatura = assinatura;
+            num_analisados++;
+        }
+
+        // Stored files are still used by cross-tabs driven by other files, so
+        // only their size in the partition is cleared
+        for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+            if (reaproveitado[i])
+                mapas[i].tamanho = 0;
+
+        printf("Modo incremental: %d arquivos reaproveitados, %d analisados.\n", num_reaproveitados, num_analisados);
+    }
+    if (opcoes.incremental)
+    {
+        unsigned long long hashes[TOTAL_ARQUIVOS] = {0};
+        hashear_arquivos(a_hashear, tamanhos_hash, TOTAL_ARQUIVOS, rank, size, hashes);
+        if (rank == 0)
+            for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+                if (a_hashear[i][0])
+                    registros[i].hash = hashes[i];
+    }
+    MPI_Bcast(mapas, sizeof(mapas), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(cruzamentos, sizeof(cruzamentos), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    for (int i = 0; i < TOTAL_ARQUIVOS; i++)
+    {
+        if (mapas[i].em_cache)
+            strcpy(arquivos[i], caches[i]);
+        else if (mapas[i].entrada.formato != FORMATO_TEXTO)
+            strcpy(arquivos[i], fontes[i]);
+    }
+    somar_fase(FASE_CABECALHOS, MPI_Wtime() - inicio_fase, 0, 0);
+
+#ifndef _WIN32
+    // With --servidor the processes keep their rows in memory and answer
+    // queries until a client stops them, instead of printing the report
+    if (opcoes.servidor)
+    {
+        int resultado = executar_servidor(opcoes.servidor, arquivos, mapas, cursos_em_cache ? caches[0] : arquivos[0],
+                                          cursos_em_cache, rank, size, opcoes.num_threads);
+        free(mapa_cursos_ads);
+        MPI_Finalize();
+        return resultado == 0 ? 0 : 1;
+    }
+#endif
+
+    // Divides the bytes of all files equally among processes or, in dynamic mode,
+    // lists all chunks so that each process takes the next free one on demand
+    Bloco *blocos;
+    Resultados *por_arquivo_local = calloc(TOTAL_ARQUIVOS, sizeof(Resultados));
+    int num_blocos = opcoes.dinamico
+                         ? dividir_blocos(mapas, TOTAL_ARQUIVOS, 0, 1, opcoes.tamanho_bloco, size * opcoes.num_threads, &blocos)
+                         : dividir_blocos(mapas, TOTAL_ARQUIVOS, rank, size, opcoes.tamanho_bloco, opcoes.num_threads, &blocos);
+
+    // With MPI-IO the text files are read collectively; only the chunks of
+    // cached and compressed files are left to the scheduler
+    if (opcoes.mpi_io)
+    {
+        processar_mpi_io(arquivos, mapas, TOTAL_ARQUIVOS, rank, size, opcoes.num_threads, por_arquivo_local);
 
-    // Divides files among processes (except file 0, which was used to extract courses)
-    int arquivos_por_proc = (TOTAL_ARQUIVOS - 1) / size;
-    int resto = (TOTAL_ARQUIVOS - 1) % size;
-    int inicio = rank * arquivos_por_proc + (rank < resto ? rank : resto) + 1; // Starts from file 1 (index 0)
-    int fim = inicio + arquivos_por_proc + (rank < resto ? 1 : 0);
+        int restantes = 0;
+        for (int b = 0; b < num_blocos; b++)
+            if (mapas[blocos[b].arquivo].em_cache || mapas[blocos[b].arquivo].entrada.formato != FORMATO_TEXTO)
+                blocos[restantes++] = blocos[b];
+        num_blocos = restantes;
+    }
+
+    Escalonador escalonador;
+    iniciar_escalonador(&escalonador, blocos, num_blocos, opcoes.dinamico, rank);
 
-    // Each process counts the responses of the files assigned to it
-    for (int i = inicio; i < fim && i < TOTAL_ARQUIVOS; i++)
+    // Each process counts the responses of the chunks assigned to it. With
+    // several threads, each one counts into its own blocks, merged at the end.
+    inicio_fase = MPI_Wtime();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(opcoes.num_threads)
+#endif
     {
-        contar_respostas(arquivos[i], "QE_I15", 6, contadores_QE_I15_local, &ignoradas_I15_local, &total_alunos_ads_local, &contadores_QE_I15_vazio_local);
-        contar_respostas(arquivos[i], "QE_I22", 5, contadores_QE_I22_local, &ignoradas_I22_local, &total_alunos_ads_local, &contadores_QE_I22_vazio_local);
-        contar_respostas(arquivos[i], "QE_I23", 5, contadores_QE_I23_local, &ignoradas_I23_local, &total_alunos_ads_local, &contadores_QE_I23_vazio_local);
-        contar_respostas(arquivos[i], "TP_SEXO", 2, contadores_TP_SEXO_local, &ignoradas_SEXO_local, &total_alunos_ads_local, &contadores_TP_SEXO_vazio_local);
-        contar_respostas(arquivos[i], "QE_I18", 5, contadores_QE_I18_local, &ignoradas_I18_local, &total_alunos_ads_local, &contadores_QE_I18_vazio_local);
-        contar_respostas(arquivos[i], "QE_I19", 7, contadores_QE_I19_local, &ignoradas_I19_local, &total_alunos_ads_local, &contadores_QE_I19_vazio_local);
-        contar_respostas(arquivos[i], "QE_I21", 2, contadores_QE_I21_local, &ignoradas_I21_local, &total_alunos_ads_local, &contadores_QE_I21_vazio_local);
-        contar_respostas(arquivos[i], "TP_PR_GER", 5, contadores_TP_PR_GER_local, &ignoradas_PR_GER_local, &total_alunos_ads_local, &contadores_TP_PR_GER_vazio_local);
+        Resultados *por_arquivo_thread = calloc(TOTAL_ARQUIVOS, sizeof(Resultados));
+
+        processar_blocos(arquivos, mapas, &escalonador, opcoes.leitura_antecipada ? &opcoes.leitura : NULL, por_arquivo_thread);
+
+#ifdef _OPENMP
+#pragma omp critical(somar_resultados)
+#endif
+        for (int i = 0; i < TOTAL_ARQUIVOS; i++)
+            somar_resultados(&por_arquivo_local[i], &por_arquivo_thread[i]);
+        free(por_arquivo_thread);
     }
+    somar_fase(FASE_CONTAGEM, MPI_Wtime() - inicio_fase, 0, 0);
 
     // --- MPI Reduction: Sums local results to global in process 0 ---
 
-    // Reduces counters for each question
-    MPI_Reduce(contadores_QE_I15_local, contadores_QE_I15_global, 6, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_QE_I22_local, contadores_QE_I22_global, 5, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_QE_I23_local, contadores_QE_I23_global, 5, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_TP_SEXO_local, contadores_TP_SEXO_global, 2, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_QE_I18_local, contadores_QE_I18_global, 5, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_QE_I19_local, contadores_QE_I19_global, 7, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_QE_I21_local, contadores_QE_I21_global, 2, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(contadores_TP_PR_GER_local, contadores_TP_PR_GER_global, 5, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-
-    // Reduces counters for empty responses
-    MPI_Reduce(&contadores_QE_I15_vazio_local, &contadores_QE_I15_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_QE_I22_vazio_local, &contadores_QE_I22_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_QE_I23_vazio_local, &contadores_QE_I23_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_TP_SEXO_vazio_local, &contadores_TP_SEXO_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_QE_I18_vazio_local, &contadores_QE_I18_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_QE_I19_vazio_local, &contadores_QE_I19_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_QE_I21_vazio_local, &contadores_QE_I21_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&contadores_TP_PR_GER_vazio_local, &contadores_TP_PR_GER_vazio_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-
-    // Reduces the total number of analyzed ADS students (to ensure it is summed once per student)
-    MPI_Reduce(&total_alunos_ads_local, &total_alunos_ads_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-
-    // Reduces counters for ignored incomplete lines
-    MPI_Reduce(&ignoradas_I15_local, &ignoradas_I15_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_I22_local, &ignoradas_I22_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_I23_local, &ignoradas_I23_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_SEXO_local, &ignoradas_SEXO_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_I18_local, &ignoradas_I18_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_I19_local, &ignoradas_I19_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_I21_local, &ignoradas_I21_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&ignoradas_PR_GER_local, &ignoradas_PR_GER_global, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    // All counters go in one non-blocking reduction; a rank that finishes early
+    // posts its part and only waits for the collective when it has to. The
+    // score summaries are not plain sums, so the reduction uses its own MPI_Op.
+    // In incremental mode the counters are reduced per file, with the stored
+    // ones merged by process 0, so the fresh ones can be saved.
+    inicio_fase = MPI_Wtime();
+    MPI_Request pedido_reducao;
+    MPI_Datatype tipo_resultados;
+    MPI_Op op_resultados;
+    criar_reducao_resultados(&tipo_resultados, &op_resultados);
+    Resultados *por_arquivo_global = NULL;
+    if (opcoes.incremental)
+    {
+        if (rank == 0)
+        {
+            por_arquivo_global = calloc(TOTAL_ARQUIVOS, sizeof(Resultados));
+            for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+                if (reaproveitado[i])
+                    por_arquivo_local[i] = registros[i].resultados;
+        }
+        MPI_Ireduce(por_arquivo_local, por_arquivo_global, TOTAL_ARQUIVOS, tipo_resultados, op_resultados, 0, MPI_COMM_WORLD, &pedido_reducao);
+    }
+    else
+    {
+        for (int i = 0; i < TOTAL_ARQUIVOS; i++)
+            somar_resultados(&resultados_local, &por_arquivo_local[i]);
+        MPI_Ireduce(&resultados_local, &resultados_global, 1, tipo_resultados, op_resultados, 0, MPI_COMM_WORLD, &pedido_reducao);
+    }
+
+    finalizar_escalonador(&escalonador);
+    free(blocos);
+
+    MPI_Wait(&pedido_reducao, MPI_STATUS_IGNORE);
+    MPI_Op_free(&op_resultados);
+    MPI_Type_free(&tipo_resultados);
+    free(por_arquivo_local);
+    somar_fase(FASE_REDUCAO, MPI_Wtime() - inicio_fase, (long long)sizeof(Resultados) * (opcoes.incremental ? TOTAL_ARQUIVOS : 1), 0);
+
+    // Process 0 saves the counters of the files counted in this run
+    if (opcoes.incremental && rank == 0)
+    {
+        criar_diretorio("2.DADOS/resultados");
+        for (int i = 1; i < TOTAL_ARQUIVOS; i++)
+        {
+            somar_resultados(&resultados_global, &por_arquivo_global[i]);
+            if (registros[i].versao == 0 || reaproveitado[i])
+                continue;
+
+            registros[i].resultados = por_arquivo_global[i];
+            if (salvar_resultado(salvos[i], &registros[i]) != 0)
+                fprintf(stderr, "Aviso: não foi possível salvar os resultados de %s em %s\n", arquivos[i], salvos[i]);
+        }
+        free(por_arquivo_global);
+        free(registros);
+    }
+
+    // Phase metrics of all processes, written by process 0
+    metricas.segundos[FASE_TOTAL] = MPI_Wtime() - inicio_total;
+    for (int f = 0; f < FASE_TOTAL; f++)
+    {
+        metricas.bytes[FASE_TOTAL] += f == FASE_REDUCAO ? 0 : metricas.bytes[f];
+        metricas.linhas[FASE_TOTAL] += metricas.linhas[f];
+    }
+    if (opcoes.metricas)
+    {
+        Metricas *todas = rank == 0 ? malloc(size * sizeof(Metricas)) : NULL;
+        MPI_Gather(&metricas, sizeof(Metricas), MPI_BYTE, todas, sizeof(Metricas), MPI_BYTE, 0, MPI_COMM_WORLD);
+        if (rank == 0)
+        {
+            if (escrever_metricas(opcoes.metricas, todas, size, opcoes.num_threads) != 0)
+                fprintf(stderr, "Aviso: não foi possível gravar as métricas em %s\n", opcoes.metricas);
+            free(todas);
+        }
+    }
 
     // Process 0 prints the aggregated results
     if (rank == 0)
@@ -418,77 +4604,85 @@ int main(int argc, char *argv[])
         printf("=== RESULTADOS DA ANÁLISE DE DADOS ENADE PARA ALUNOS DE ADS ===\n");
         printf("-------------------------------------------------------------------\n");
 
-        int total_afirmativas = contadores_QE_I15_global[1] + contadores_QE_I15_global[2] + contadores_QE_I15_global[3] + contadores_QE_I15_global[4] + contadores_QE_I15_global[5];
-        printf("\n   Total de alunos que entraram por ações afirmativas: %d\n", total_afirmativas);
-        printf("     Percentual de alunos provenientes de ações afirmativas: %.2f%%\n", ((double)total_afirmativas / total_alunos_ads_global * 100.0));
+        long long total_afirmativas = resultados_global.questoes[Q_I15].contadores[1] + resultados_global.questoes[Q_I15].contadores[2] + resultados_global.questoes[Q_I15].contadores[3] + resultados_global.questoes[Q_I15].contadores[4] + resultados_global.questoes[Q_I15].contadores[5];
+        printf("\n   Total de alunos que entraram por ações afirmativas: %lld\n", total_afirmativas);
+        printf("     Percentual de alunos provenientes de ações afirmativas: %.2f%%\n", ((double)total_afirmativas / resultados_global.total_alunos_ads * 100.0));
 
         printf("\nQE_I22 - Número de livros lidos no ano (exceto didáticos):\n");
-        printf("   A (Nenhum): %d\n", contadores_QE_I22_global[0]);
-        printf("   B (1 a 2 livros): %d\n", contadores_QE_I22_global[1]);
-        printf("   C (3 a 5 livros): %d\n", contadores_QE_I22_global[2]);
-        printf("   D (6 a 8 livros): %d\n", contadores_QE_I22_global[3]);
-        printf("   E (Mais de 8 livros): %d\n", contadores_QE_I22_global[4]);
-        printf("   Respostas Vazias (QE_I22): %d\n", contadores_QE_I22_vazio_global);
-        printf("   Linhas ignoradas por incompletude (QE_I22): %d\n", ignoradas_I22_global);
+        printf("   A (Nenhum): %lld\n", resultados_global.questoes[Q_I22].contadores[0]);
+        printf("   B (1 a 2 livros): %lld\n", resultados_global.questoes[Q_I22].contadores[1]);
+        printf("   C (3 a 5 livros): %lld\n", resultados_global.questoes[Q_I22].contadores[2]);
+        printf("   D (6 a 8 livros): %lld\n", resultados_global.questoes[Q_I22].contadores[3]);
+        printf("   E (Mais de 8 livros): %lld\n", resultados_global.questoes[Q_I22].contadores[4]);
+        printf("   Respostas Vazias (QE_I22): %lld\n", resultados_global.questoes[Q_I22].vazio);
+        printf("   Linhas ignoradas por incompletude (QE_I22): %lld\n", resultados_global.questoes[Q_I22].ignoradas);
 
         printf("\nQE_I23 - Quantas horas por semana, aproximadamente, você dedicou aos estudos, excetuando as horas de aula?\n");
-        printf("   A (Nenhuma, apenas assisto às aulas): %d\n", contadores_QE_I23_global[0]);
-        printf("   B (De uma a três): %d\n", contadores_QE_I23_global[1]);
-        printf("   C (De quatro a sete): %d\n", contadores_QE_I23_global[2]);
-        printf("   D (De oito a doze): %d\n", contadores_QE_I23_global[3]);
-        printf("   E (Mais de doze): %d\n", contadores_QE_I23_global[4]);
-        printf("   Respostas Vazias (QE_I23): %d\n", contadores_QE_I23_vazio_global);
-        printf("   Linhas ignoradas por incompletude (QE_I23): %d\n", ignoradas_I23_global);
+        printf("   A (Nenhuma, apenas assisto às aulas): %lld\n", resultados_global.questoes[Q_I23].contadores[0]);
+        printf("   B (De uma a três): %lld\n", resultados_global.questoes[Q_I23].contadores[1]);
+        printf("   C (De quatro a sete): %lld\n", resultados_global.questoes[Q_I23].contadores[2]);
+        printf("   D (De oito a doze): %lld\n", resultados_global.questoes[Q_I23].contadores[3]);
+        printf("   E (Mais de doze): %lld\n", resultados_global.questoes[Q_I23].contadores[4]);
+        printf("   Respostas Vazias (QE_I23): %lld\n", resultados_global.questoes[Q_I23].vazio);
+        printf("   Linhas ignoradas por incompletude (QE_I23): %lld\n", resultados_global.questoes[Q_I23].ignoradas);
 
         // --- Added new questions ---
         printf("\nTP_SEXO - Sexo:\n");
-        printf("   M (Masculino): %d\n", contadores_TP_SEXO_global[0]);
-        printf("   F (Feminino): %d\n", contadores_TP_SEXO_global[1]);
-        printf("   Respostas Vazias (TP_SEXO): %d\n", contadores_TP_SEXO_vazio_global);
-        printf("   Linhas ignoradas por incompletude (TP_SEXO): %d\n", ignoradas_SEXO_global);
-        printf("Porcentagem de estudantes do sexo Feminino: %.2f%%\n", ((double)contadores_TP_SEXO_global[1] / total_alunos_ads_global * 100.0));
+        printf("   M (Masculino): %lld\n", resultados_global.questoes[Q_SEXO].contadores[0]);
+        printf("   F (Feminino): %lld\n", resultados_global.questoes[Q_SEXO].contadores[1]);
+        printf("   Respostas Vazias (TP_SEXO): %lld\n", resultados_global.questoes[Q_SEXO].vazio);
+        printf("   Linhas ignoradas por incompletude (TP_SEXO): %lld\n", resultados_global.questoes[Q_SEXO].ignoradas);
+        printf("Porcentagem de estudantes do sexo Feminino: %.2f%%\n", ((double)resultados_global.questoes[Q_SEXO].contadores[1] / resultados_global.total_alunos_ads * 100.0));
 
         printf("\nQE_I18 - Qual modalidade de ensino médio você concluiu?\n");
-        printf("   A (Ensino médio tradicional): %d\n", contadores_QE_I18_global[0]);
-        printf("   B (Profissionalizante técnico): %d\n", contadores_QE_I18_global[1]);
-        printf("   C (Profissionalizante magistério): %d\n", contadores_QE_I18_global[2]);
-        printf("   D (Educação de Jovens e Adultos (EJA) e/ou Supletivo): %d\n", contadores_QE_I18_global[3]);
-        printf("   E (Outra modalidade): %d\n", contadores_QE_I18_global[4]);
-        printf("   Respostas Vazias (QE_I18): %d\n", contadores_QE_I18_vazio_global);
-        printf("   Linhas ignoradas por incompletude (QE_I18): %d\n", ignoradas_I18_global);
-        printf("Porcentagem de estudantes que cursaram o ensino técnico no ensino médio: %.2f%%\n", ((double)contadores_QE_I18_global[1] / total_alunos_ads_global * 100.0));
+        printf("   A (Ensino médio tradicional): %lld\n", resultados_global.questoes[Q_I18].contadores[0]);
+        printf("   B (Profissionalizante técnico): %lld\n", resultados_global.questoes[Q_I18].contadores[1]);
+        printf("   C (Profissionalizante magistério): %lld\n", resultados_global.questoes[Q_I18].contadores[2]);
+        printf("   D (Educação de Jovens e Adultos (EJA) e/ou Supletivo): %lld\n", resultados_global.questoes[Q_I18].contadores[3]);
+        printf("   E (Outra modalidade): %lld\n", resultados_global.questoes[Q_I18].contadores[4]);
+        printf("   Respostas Vazias (QE_I18): %lld\n", resultados_global.questoes[Q_I18].vazio);
+        printf("   Linhas ignoradas por incompletude (QE_I18): %lld\n", resultados_global.questoes[Q_I18].ignoradas);
+        printf("Porcentagem de estudantes que cursaram o ensino técnico no ensino médio: %.2f%%\n", ((double)resultados_global.questoes[Q_I18].contadores[1] / resultados_global.total_alunos_ads * 100.0));
 
         printf("\nQE_I19 - Quem mais lhe incentivou a cursar a graduação?\n");
-        printf("   A (Ninguém): %d\n", contadores_QE_I19_global[0]);
-        printf("   B (Pais): %d\n", contadores_QE_I19_global[1]);
-        printf("   C (Outros membros da família que não os pais): %d\n", contadores_QE_I19_global[2]);
-        printf("   D (Professores): %d\n", contadores_QE_I19_global[3]);
-        printf("   E (Líder ou representante religioso): %d\n", contadores_QE_I19_global[4]);
-        printf("   F (Colegas/Amigos): %d\n", contadores_QE_I19_global[5]);
-        printf("   G (Outras pessoas): %d\n", contadores_QE_I19_global[6]);
-        printf("   Respostas Vazias (QE_I19): %d\n", contadores_QE_I19_vazio_global);
-        printf("   Linhas ignoradas por incompletude (QE_I19): %d\n", ignoradas_I19_global);
+        printf("   A (Ninguém): %lld\n", resultados_global.questoes[Q_I19].contadores[0]);
+        printf("   B (Pais): %lld\n", resultados_global.questoes[Q_I19].contadores[1]);
+        printf("   C (Outros membros da família que não os pais): %lld\n", resultados_global.questoes[Q_I19].contadores[2]);
+        printf("   D (Professores): %lld\n", resultados_global.questoes[Q_I19].contadores[3]);
+        printf("   E (Líder ou representante religioso): %lld\n", resultados_global.questoes[Q_I19].contadores[4]);
+        printf("   F (Colegas/Amigos): %lld\n", resultados_global.questoes[Q_I19].contadores[5]);
+        printf("   G (Outras pessoas): %lld\n", resultados_global.questoes[Q_I19].contadores[6]);
+        printf("   Respostas Vazias (QE_I19): %lld\n", resultados_global.questoes[Q_I19].vazio);
+        printf("   Linhas ignoradas por incompletude (QE_I19): %lld\n", resultados_global.questoes[Q_I19].ignoradas);
 
         printf("\nQE_I21 - Alguém em sua família concluiu um curso superior?\n");
-        printf("   A (Sim): %d\n", contadores_QE_I21_global[0]);
-        printf("   B (Não): %d\n", contadores_QE_I21_global[1]);
-        printf("   Respostas Vazias (QE_I21): %d\n", contadores_QE_I21_vazio_global);
-        printf("   Linhas ignoradas por incompletude (QE_I21): %d\n", ignoradas_I21_global);
+        printf("   A (Sim): %lld\n", resultados_global.questoes[Q_I21].contadores[0]);
+        printf("   B (Não): %lld\n", resultados_global.questoes[Q_I21].contadores[1]);
+        printf("   Respostas Vazias (QE_I21): %lld\n", resultados_global.questoes[Q_I21].vazio);
+        printf("   Linhas ignoradas por incompletude (QE_I21): %lld\n", resultados_global.questoes[Q_I21].ignoradas);
 
         printf("\nTP_PR_GER - Tipo de presença na prova:\n");
-        printf("   222 (Não se aplica - ausente): %d\n", contadores_TP_PR_GER_global[0]);
-        printf("   333 (Prova em branco): %d\n", contadores_TP_PR_GER_global[1]);
-        printf("   444 (Participação indevida por protesto): %d\n", contadores_TP_PR_GER_global[2]);
-        printf("   555 (Respostas válidas): %d\n", contadores_TP_PR_GER_global[3]);
-        printf("   556 (Resultado desconsiderado): %d\n", contadores_TP_PR_GER_global[4]);
-        printf("   Respostas Vazias (TP_PR_GER): %d\n", contadores_TP_PR_GER_vazio_global);
-        printf("   Linhas ignoradas por incompletude (TP_PR_GER): %d\n", ignoradas_PR_GER_global);
+        printf("   222 (Não se aplica - ausente): %lld\n", resultados_global.questoes[Q_PR_GER].contadores[0]);
+        printf("   333 (Prova em branco): %lld\n", resultados_global.questoes[Q_PR_GER].contadores[1]);
+        printf("   444 (Participação indevida por protesto): %lld\n", resultados_global.questoes[Q_PR_GER].contadores[2]);
+        printf("   555 (Respostas válidas): %lld\n", resultados_global.questoes[Q_PR_GER].contadores[3]);
+        printf("   556 (Resultado desconsiderado): %lld\n", resultados_global.questoes[Q_PR_GER].contadores[4]);
+        printf("   Respostas Vazias (TP_PR_GER): %lld\n", resultados_global.questoes[Q_PR_GER].vazio);
+        printf("   Linhas ignoradas por incompletude (TP_PR_GER): %lld\n", resultados_global.questoes[Q_PR_GER].ignoradas);
+
+        for (int n = 0; n < NUM_NOTAS; n++)
+            imprimir_nota(n, &resultados_global.notas[n]);
+
+        for (int c = 0; c < num_cruzamentos; c++)
+            imprimir_cruzamento(c, &resultados_global);
 
         printf("\n-------------------------------------------------------------------\n");
-        printf("Total de registros de alunos de ADS analisados (para todas as questões): %d\n", total_alunos_ads_global);
+        printf("Total de registros de alunos de ADS analisados (para todas as questões): %lld\n", resultados_global.total_alunos_ads);
         printf("-------------------------------------------------------------------\n");
     }
 
+    free(mapa_cursos_ads);
+
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file